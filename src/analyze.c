@@ -0,0 +1,201 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "analyze.h"
+
+#define ANALYZE_STAGE 2 // V_start -> V_stop
+
+// === sliding least squares
+static void fit_init(struct fit *f, int size)
+{
+	memset(f, 0, sizeof(struct fit));
+	f->size = size;
+}
+
+static void fit_add(struct fit *f, double x, double y)
+{
+	double xo, yo;
+
+	if (f->n == f->size)
+	{
+		xo = f->x[f->head];
+		yo = f->y[f->head];
+		f->sx  -= xo;
+		f->sy  -= yo;
+		f->sxx -= xo * xo;
+		f->sxy -= xo * yo;
+	}
+	else
+		f->n++;
+
+	f->x[f->head] = x;
+	f->y[f->head] = y;
+	f->head = (f->head + 1) % f->size;
+	f->sx  += x;
+	f->sy  += y;
+	f->sxx += x * x;
+	f->sxy += x * y;
+}
+
+// slope and intercept, returns -1 while the window is not full or degenerate
+static int fit_line(const struct fit *f, double *slope, double *intercept)
+{
+	double d;
+
+	if (f->n < f->size)
+		return -1;
+
+	d = f->n * f->sxx - f->sx * f->sx;
+	if (fabs(d) < 1e-30)
+		return -1;
+
+	*slope     = (f->n * f->sxy - f->sx * f->sy) / d;
+	*intercept = (f->sy - *slope * f->sx) / f->n;
+	return 0;
+}
+
+// === analyzer
+void analyze_init(struct analyze *a, const struct analyze_config *cfg)
+{
+	memset(a, 0, sizeof(struct analyze));
+	a->cfg = *cfg;
+	if (a->cfg.window < 3)
+		a->cfg.window = 3;
+	if (a->cfg.window > FIT_WINDOW_MAX)
+		a->cfg.window = FIT_WINDOW_MAX;
+
+	fit_init(&a->iv, a->cfg.window);
+	fit_init(&a->lg, a->cfg.window);
+	fit_init(&a->vi, a->cfg.window);
+
+	a->gm    = 0.0;
+	a->V_gm  = NAN;
+	a->Vth   = NAN;
+	a->ss    = NAN;
+	a->I_on  = 0.0;
+	a->I_off = INFINITY;
+	a->R     = NAN;
+	a->mu    = NAN;
+}
+
+int analyze_point(struct analyze *a, const struct point *p)
+{
+	double V, I, k, b, tol_V;
+
+	if ((p->stage != ANALYZE_STAGE) || a->converged)
+		return 0;
+
+	V = (a->cfg.chan == 1) ? p->V1 : p->V2;
+	I = fabs(p->I2);
+
+	if ((a->points > 0) && (a->dir == 0))
+		a->dir = (V >= a->V_last) ? 1 : -1;
+	else if ((a->points > 0) && ((V - a->V_last) * a->dir <= 0))
+		return 0;
+	a->V_last = V;
+
+	fit_add(&a->iv, V, p->I2);
+	fit_add(&a->lg, V, log10(I + FIT_FLOOR));
+	fit_add(&a->vi, p->I2, p->V2);
+	a->points++;
+
+	if (I > a->I_on)
+		a->I_on = I;
+	if (I < a->I_off)
+		a->I_off = I;
+
+	// the drain voltage is fixed on a transfer curve, scanned on an output curve
+	if (a->cfg.chan == 1)
+		a->R = (p->I2 != 0.0) ? p->V2 / p->I2 : NAN;
+	else if (fit_line(&a->vi, &k, &b) == 0)
+		a->R = k;
+
+	// transconductance peak and the extrapolated threshold at it
+	if (fit_line(&a->iv, &k, &b) == 0)
+	{
+		if ((fabs(k) > a->gm) && (k != 0.0))
+		{
+			a->gm   = fabs(k);
+			a->V_gm = a->iv.sx / a->iv.n;
+			a->Vth  = -b / k;
+			if ((a->cfg.chan == 1) && (a->cfg.mu_k > 0) && (p->V2 != 0.0))
+				a->mu = a->cfg.mu_k * a->gm / fabs(p->V2) * 1e4;
+		}
+	}
+
+	// the steepest log slope is the subthreshold swing
+	if ((fit_line(&a->lg, &k, &b) == 0) && (k != 0.0))
+		if (isnan(a->ss) || (1.0 / fabs(k) < a->ss))
+			a->ss = 1.0 / fabs(k);
+
+	if ((a->cfg.stop_tol <= 0) || (a->I_on < ANALYZE_ON_OFF * a->I_off) || isnan(a->Vth))
+		return 0;
+
+	// gm and Vth have not moved for a window since the device turned on
+	tol_V = fmax(a->cfg.stop_tol * fabs(a->Vth), ANALYZE_V_TOL);
+	if ((fabs(a->gm - a->gm_prev) <= a->cfg.stop_tol * a->gm) &&
+		(fabs(a->Vth - a->Vth_prev) <= tol_V))
+		a->stable++;
+	else
+		a->stable = 0;
+	a->gm_prev  = a->gm;
+	a->Vth_prev = a->Vth;
+
+	if (a->stable < a->cfg.window)
+		return 0;
+
+	a->converged = 1;
+	return 1;
+}
+
+int analyze_title(const struct analyze *a, char *buf, size_t len)
+{
+	int n;
+
+	if (a->points == 0)
+		return snprintf(buf, len, "no stage 2 points");
+
+	n = snprintf(buf, len, "Vth = %.3lf V, gm = %.3le S, SS = %.0lf mV/dec, on/off = %.1le, R = %.3le Ohm",
+		a->Vth, a->gm, a->ss * 1e3,
+		(a->I_off > 0) ? a->I_on / a->I_off : INFINITY,
+		a->R);
+	if ((n >= 0) && ((size_t) n < len) && !isnan(a->mu))
+		n += snprintf(buf + n, len - n, ", mu = %.3lf cm^2/Vs", a->mu);
+	if ((n >= 0) && ((size_t) n < len) && a->converged)
+		n += snprintf(buf + n, len - n, ", converged");
+	return n;
+}
+
+int analyze_print(FILE *fp, const struct analyze *a)
+{
+	return fprintf(fp,
+		"# Transfer curve parameters, stage 2\n"
+		"points    = %d\n"
+		"window    = %d\n"
+		"gm        = %le\n"
+		"V_gm      = %le\n"
+		"Vth       = %le\n"
+		"SS        = %le\n"
+		"I_on      = %le\n"
+		"I_off     = %le\n"
+		"on_off    = %le\n"
+		"R         = %le\n"
+		"mu        = %le\n"
+		"converged = %d\n"
+		"# gm, S; V_gm, Vth, V; SS, V/decade; I_on, I_off, A; R, Ohm; mu, cm^2/(V s)\n",
+		a->points,
+		a->cfg.window,
+		a->gm,
+		a->V_gm,
+		a->Vth,
+		a->ss,
+		a->I_on,
+		(a->points > 0) ? a->I_off : NAN,
+		(a->I_off > 0) ? a->I_on / a->I_off : INFINITY,
+		a->R,
+		a->mu,
+		a->converged
+	);
+}
@@ -0,0 +1,79 @@
+#ifndef ANALYZE_H
+#define ANALYZE_H
+
+#include <stdio.h>
+#include <stddef.h>
+
+#include "point.h"
+
+// === [ANALYZE] ===
+#define FIT_WINDOW     5      // default points per sliding fit
+#define FIT_WINDOW_MAX 100
+#define FIT_FLOOR      1e-15  // added to |I| before taking the log, A
+#define ANALYZE_ON_OFF 1e3    // on/off ratio before the estimates may converge
+#define ANALYZE_V_TOL  0.01   // absolute Vth change treated as stable, V
+
+// least squares line of y on x over the last <size> points, the sums are
+// updated with the new point and the one leaving the window
+struct fit
+{
+	double x[FIT_WINDOW_MAX];
+	double y[FIT_WINDOW_MAX];
+	int    size;
+	int    n;
+	int    head;
+	double sx, sy, sxx, sxy;
+};
+
+struct analyze_config
+{
+	int    chan;     // scanning channel, 1 - transfer curve, 2 - output curve
+	int    window;   // points per fit
+	double mu_k;     // L / (W * Ci), m^2 / F, 0 - mobility unknown
+	double stop_tol; // relative change of converged estimates, 0 - never
+};
+
+// transfer curve parameters of the stage 2 points seen so far
+struct analyze
+{
+	struct analyze_config cfg;
+
+	struct fit iv; // I2 vs scanning voltage
+	struct fit lg; // log10|I2| vs scanning voltage
+	struct fit vi; // V2 vs I2, four probe resistance
+
+	int    points;
+	double gm;     // largest |dI2/dV| of a window, S
+	double V_gm;   // window centre of gm, V
+	double Vth;    // linear extrapolation at gm, V
+	double ss;     // smallest dV/dlog10|I2|, V/decade
+	double I_on;   // largest |I2|, A
+	double I_off;  // smallest |I2|, A
+	double R;      // V2 / I2, Ohm
+	double mu;     // linear mobility, cm^2 / (V s)
+
+	// sweep direction of the first two points, a point that does not step
+	// on from the last one retraces the curve after compliance
+	int    dir;
+	double V_last;
+
+	// convergence
+	double gm_prev;
+	double Vth_prev;
+	int    stable;
+	int    converged;
+};
+
+void analyze_init(struct analyze *a, const struct analyze_config *cfg);
+
+// feed one point, points outside stage 2 and retraced points are skipped
+// returns 1 once when the estimates have converged
+int  analyze_point(struct analyze *a, const struct point *p);
+
+// one line summary for the plot title
+int  analyze_title(const struct analyze *a, char *buf, size_t len);
+
+// commented "name = value" summary
+int  analyze_print(FILE *fp, const struct analyze *a);
+
+#endif
@@ -0,0 +1,431 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/ioctl.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <linux/usb/tmc.h>
+
+#include "instrument.h"
+
+#define USBTMC_TIMEOUT_MIN 100 // smallest timeout the usbtmc driver accepts, ms
+
+static double ins_now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int poll_ms(double t)
+{
+	return (t > 0) ? (int) (t * 1e3 + 0.999) : 0;
+}
+
+// === usbtmc backend
+// the driver has no read readiness for poll, reads block up to the driver
+// timeout instead, which is set per read when it changes
+struct usbtmc
+{
+	uint32_t timeout_ms;
+};
+
+static int usbtmc_open(struct instrument *ins, const char *dev, const struct sim_config *sim)
+{
+	(void) sim;
+
+	struct usbtmc *u;
+
+	u = calloc(1, sizeof(struct usbtmc));
+	if (u == NULL)
+		return -ENOMEM;
+
+	ins->fd = open(dev, O_RDWR | O_CLOEXEC);
+	if (ins->fd < 0)
+	{
+		free(u);
+		return -errno;
+	}
+	ins->priv = u;
+
+	return 0;
+}
+
+static int usbtmc_read(struct instrument *ins, char *buf, size_t len, double timeout)
+{
+	struct usbtmc *u = ins->priv;
+	uint32_t ms;
+	ssize_t n;
+
+	ms = poll_ms(timeout);
+	if (ms < USBTMC_TIMEOUT_MIN)
+		ms = USBTMC_TIMEOUT_MIN;
+	if ((ms != u->timeout_ms) && (ioctl(ins->fd, USBTMC_IOCTL_SET_TIMEOUT, &ms) == 0))
+		u->timeout_ms = ms;
+
+	do
+		n = read(ins->fd, buf, len);
+	while ((n < 0) && (errno == EINTR));
+
+	if (n < 0)
+		return (errno == ETIMEDOUT) ? -ETIMEDOUT : -errno;
+	return n;
+}
+
+// device clear, aborts the pending output of the instrument
+static int usbtmc_clear(struct instrument *ins)
+{
+	if (ioctl(ins->fd, USBTMC_IOCTL_CLEAR) < 0)
+		return -errno;
+	return 0;
+}
+
+static int usbtmc_reopen(struct instrument *ins)
+{
+	struct usbtmc *u = ins->priv;
+
+	close(ins->fd);
+	u->timeout_ms = 0;
+
+	ins->fd = open(ins->dev, O_RDWR | O_CLOEXEC);
+	if (ins->fd < 0)
+		return -errno;
+	return 0;
+}
+
+static void usbtmc_close(struct instrument *ins)
+{
+	if (ins->fd >= 0)
+		close(ins->fd);
+	free(ins->priv);
+}
+
+static const struct instrument_ops usbtmc_ops =
+{
+	.name   = "usbtmc",
+	.open   = usbtmc_open,
+	.read   = usbtmc_read,
+	.clear  = usbtmc_clear,
+	.reopen = usbtmc_reopen,
+	.close  = usbtmc_close
+};
+
+// === simulated SMU backend, the simulator serves the other end of a socketpair
+static int sim_open(struct instrument *ins, const char *dev, const struct sim_config *sim)
+{
+	(void) dev;
+
+	int sv[2];
+	pthread_t *thread;
+
+	thread = malloc(sizeof(pthread_t));
+	if (thread == NULL)
+		return -ENOMEM;
+
+	if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sv) == -1)
+	{
+		free(thread);
+		return -errno;
+	}
+
+	// only our end is non-blocking, the simulator reads it through stdio
+	if (fcntl(sv[0], F_SETFL, O_NONBLOCK) == -1)
+	{
+		close(sv[0]);
+		close(sv[1]);
+		free(thread);
+		return -errno;
+	}
+
+	if (sim_start(sv[1], sim, thread) != 0)
+	{
+		close(sv[0]);
+		close(sv[1]);
+		free(thread);
+		return -EAGAIN;
+	}
+
+	ins->fd   = sv[0];
+	ins->priv = thread;
+
+	return 0;
+}
+
+static int sim_read(struct instrument *ins, char *buf, size_t len, double timeout)
+{
+	struct pollfd pfd = {.fd = ins->fd, .events = POLLIN};
+	ssize_t n;
+	int r;
+
+	for (;;)
+	{
+		n = read(ins->fd, buf, len);
+		if (n >= 0)
+			return n;
+		if (errno == EINTR)
+			continue;
+		if (errno != EAGAIN)
+			return -errno;
+
+		r = poll(&pfd, 1, poll_ms(timeout));
+		if (r == 0)
+			return -ETIMEDOUT;
+		if ((r < 0) && (errno != EINTR))
+			return -errno;
+	}
+}
+
+static void sim_close(struct instrument *ins)
+{
+	pthread_t *thread = ins->priv;
+
+	// simulator thread exits on EOF
+	close(ins->fd);
+	pthread_join(*thread, NULL);
+	free(thread);
+}
+
+static const struct instrument_ops sim_ops =
+{
+	.name   = "sim",
+	.open   = sim_open,
+	.read   = sim_read,
+	.clear  = NULL,
+	.reopen = NULL,
+	.close  = sim_close
+};
+
+// === framing
+static int ins_write(struct instrument *ins, const char *cmd)
+{
+	struct pollfd pfd = {.fd = ins->fd, .events = POLLOUT};
+	size_t len = strlen(cmd);
+	double deadline = ins_now() + ins->timeout;
+	ssize_t n;
+	int r;
+
+	while (len > 0)
+	{
+		n = write(ins->fd, cmd, len);
+		if (n > 0)
+		{
+			cmd += n;
+			len -= n;
+			continue;
+		}
+		if ((n < 0) && (errno != EAGAIN) && (errno != EINTR))
+			return (errno == ETIMEDOUT) ? -ETIMEDOUT : -errno;
+
+		r = poll(&pfd, 1, poll_ms(deadline - ins_now()));
+		if (r == 0)
+			return -ETIMEDOUT;
+		if ((r < 0) && (errno != EINTR))
+			return -errno;
+	}
+
+	return 0;
+}
+
+// one response line without the line end, a longer line is truncated to len
+static int ins_line(struct instrument *ins, char *buf, size_t len)
+{
+	double deadline = ins_now() + ins->timeout;
+	double left;
+	size_t out = 0;
+	size_t n, m;
+	char *nl;
+	int r;
+
+	for (;;)
+	{
+		n  = ins->rx_len - ins->rx_head;
+		nl = memchr(ins->rx + ins->rx_head, '\n', n);
+		if (nl != NULL)
+			n = nl - (ins->rx + ins->rx_head);
+
+		m = (out + n < len) ? n : len - 1 - out;
+		memcpy(buf + out, ins->rx + ins->rx_head, m);
+		out += m;
+		ins->rx_head += n;
+
+		if (nl != NULL)
+		{
+			ins->rx_head++;
+			buf[out] = '\0';
+			return 0;
+		}
+		ins->rx_head = 0;
+		ins->rx_len  = 0;
+
+		left = deadline - ins_now();
+		if (left <= 0)
+			return -ETIMEDOUT;
+
+		r = ins->ops->read(ins, ins->rx, INS_RX, left);
+		if (r < 0)
+			return r;
+		if (r == 0)
+			return -ENODATA;
+		ins->rx_len = r;
+	}
+}
+
+// ask for a marker and drop every line before it, the late responses
+// of the timed out queries arrive ahead of it
+static int ins_sync(struct instrument *ins)
+{
+	char line[128];
+	char cmd[64];
+	double magic, seq;
+	int r;
+
+	ins->sync = (ins->sync + 1) % INS_SYNC_MOD;
+	snprintf(cmd, sizeof(cmd), "print(%d, %d)\n", INS_SYNC_MAGIC, ins->sync);
+
+	r = ins_write(ins, cmd);
+	while (r == 0)
+	{
+		r = ins_line(ins, line, sizeof(line));
+		if ((r == 0) && (sscanf(line, "%lf %lf", &magic, &seq) == 2) &&
+			(magic == INS_SYNC_MAGIC) && (seq == ins->sync))
+			return 0;
+	}
+	return r;
+}
+
+// bring the link back in step after a failed query, a lost device and the
+// last repeat open the device again, the instrument output is cleared
+static int ins_recover(struct instrument *ins, int err, int last)
+{
+	int r;
+
+	ins->rx_head = 0;
+	ins->rx_len  = 0;
+
+	if ((err != -ETIMEDOUT) || last)
+	{
+		if (ins->ops->reopen != NULL)
+		{
+			r = ins->ops->reopen(ins);
+			if (r < 0)
+				return r;
+			ins->reconnects++;
+		}
+		else if (err != -ETIMEDOUT)
+			return err;
+	}
+
+	if (ins->ops->clear != NULL)
+		ins->ops->clear(ins);
+	return ins_sync(ins);
+}
+
+// === public interface
+int ins_open(struct instrument *ins, const char *dev, const struct sim_config *sim)
+{
+	memset(ins, 0, sizeof(struct instrument));
+
+	ins->dev     = dev;
+	ins->ops     = (strcmp(dev, INS_DEV_SIM) == 0) ? &sim_ops : &usbtmc_ops;
+	ins->fd      = -1;
+	ins->timeout = INS_TIMEOUT;
+	ins->retries = INS_RETRIES;
+
+	return ins->ops->open(ins, dev, sim);
+}
+
+void ins_close(struct instrument *ins)
+{
+	ins->ops->close(ins);
+}
+
+// format command into buf, or into heap memory when it does not fit
+static char *ins_format(char *buf, size_t len, const char *fmt, va_list ap)
+{
+	va_list aq;
+	char *s;
+	int n;
+
+	va_copy(aq, ap);
+	n = vsnprintf(buf, len, fmt, aq);
+	va_end(aq);
+	if (n < 0)
+		return NULL;
+	if ((size_t) n < len)
+		return buf;
+
+	s = malloc(n + 1);
+	if (s != NULL)
+		vsnprintf(s, n + 1, fmt, ap);
+	return s;
+}
+
+int ins_printf(struct instrument *ins, const char *fmt, ...)
+{
+	char buf[1024];
+	char *cmd;
+	va_list ap;
+	int r;
+
+	va_start(ap, fmt);
+	cmd = ins_format(buf, sizeof(buf), fmt, ap);
+	va_end(ap);
+	if (cmd == NULL)
+		return -ENOMEM;
+
+	r = ins_write(ins, cmd);
+
+	if (cmd != buf)
+		free(cmd);
+	return r;
+}
+
+int ins_query(struct instrument *ins, char *buf, size_t len, const char *fmt, ...)
+{
+	char cbuf[1024];
+	char *cmd;
+	va_list ap;
+	int k, r;
+
+	va_start(ap, fmt);
+	cmd = ins_format(cbuf, sizeof(cbuf), fmt, ap);
+	va_end(ap);
+	if (cmd == NULL)
+		return -ENOMEM;
+
+	for (k = 0; ; k++)
+	{
+		r = ins_write(ins, cmd);
+		if (r == 0)
+			r = ins_line(ins, buf, len);
+		if (r == 0)
+			break;
+
+		if (r == -ETIMEDOUT)
+			ins->timeouts++;
+		if (k == ins->retries)
+		{
+			// leave the link in step for the next query
+			if (r == -ETIMEDOUT)
+				ins_recover(ins, r, 0);
+			break;
+		}
+		ins->repeats++;
+
+		r = ins_recover(ins, r, k + 1 == ins->retries);
+		if (r < 0)
+			break;
+	}
+
+	if (cmd != cbuf)
+		free(cmd);
+	return r;
+}
@@ -0,0 +1,73 @@
+#ifndef INSTRUMENT_H
+#define INSTRUMENT_H
+
+#include <stdio.h>
+#include <stddef.h>
+
+#include "sim.h"
+
+// === [INSTRUMENT] ===
+#define INS_DEV_FILE "/dev/usbtmc0"
+#define INS_DEV_SIM  "sim"
+#define INS_TIMEOUT  5.0   // response deadline per query, s
+#define INS_RETRIES  2     // repeats of a query after a timeout
+#define INS_RX       4096  // receive buffer, bytes
+
+// resync marker "print(INS_SYNC_MAGIC, seq)", both exact in 6 digits
+#define INS_SYNC_MAGIC 271828
+#define INS_SYNC_MOD   10000
+
+struct instrument;
+
+// backend operations on the raw file descriptor
+// read returns the byte count, 0 on EOF, -ETIMEDOUT after timeout seconds
+// clear drops whatever the instrument still has to send, may be NULL
+// reopen connects again after a lost device, NULL if it can not
+struct instrument_ops
+{
+	const char *name;
+	int  (*open)  (struct instrument *ins, const char *dev, const struct sim_config *sim);
+	int  (*read)  (struct instrument *ins, char *buf, size_t len, double timeout);
+	int  (*clear) (struct instrument *ins);
+	int  (*reopen)(struct instrument *ins);
+	void (*close) (struct instrument *ins);
+};
+
+struct instrument
+{
+	const struct instrument_ops *ops;
+	const char *dev;
+	int   fd;
+	void *priv;
+
+	double timeout; // s
+	int    retries;
+
+	// received bytes past the last returned line
+	char   rx[INS_RX];
+	size_t rx_head;
+	size_t rx_len;
+
+	int    sync;    // last resync marker
+
+	// transport counters
+	unsigned long timeouts;
+	unsigned long repeats;
+	unsigned long reconnects;
+};
+
+// open "sim" or a usbtmc device file
+int  ins_open(struct instrument *ins, const char *dev, const struct sim_config *sim);
+void ins_close(struct instrument *ins);
+
+// send formatted command
+int  ins_printf(struct instrument *ins, const char *fmt, ...)
+	__attribute__ ((format (printf, 2, 3)));
+
+// send formatted command and read one response line into buf, a query
+// that times out is repeated up to <retries> times once the stale
+// responses are dropped, the device is opened again before the last repeat
+int  ins_query(struct instrument *ins, char *buf, size_t len, const char *fmt, ...)
+	__attribute__ ((format (printf, 4, 5)));
+
+#endif
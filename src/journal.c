@@ -0,0 +1,234 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdarg.h>
+#include <inttypes.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#include "journal.h"
+
+// === writer
+static int journal_write(struct journal *j, const char *fmt, ...)
+	__attribute__ ((format (printf, 2, 3)));
+
+int journal_open(struct journal *j, const char *path, int append)
+{
+	struct stat st;
+	char buf[256];
+	off_t end;
+	ssize_t n, k, m;
+	int r;
+
+	j->fd = open(path, O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC | (append ? 0 : O_TRUNC), 0644);
+	if (j->fd < 0)
+		return -errno;
+	if (!append)
+		return 0;
+
+	if (fstat(j->fd, &st) < 0)
+	{
+		r = -errno;
+		goto journal_open_error;
+	}
+
+	// the partial line of a killed process is cut off, a record cut inside
+	// a number would still parse once a new record ended its line
+	for (end = st.st_size; end > 0; end -= n - k)
+	{
+		n = (end < (off_t) sizeof(buf)) ? end : (off_t) sizeof(buf);
+		// a short read is a file cut under us
+		m = pread(j->fd, buf, n, end - n);
+		if (m != n)
+		{
+			r = (m < 0) ? -errno : -EIO;
+			goto journal_open_error;
+		}
+		for (k = n; (k > 0) && (buf[k - 1] != '\n'); k--)
+			;
+		if (k > 0)
+		{
+			end -= n - k;
+			break;
+		}
+	}
+	if ((end < st.st_size) && (ftruncate(j->fd, end) < 0))
+	{
+		r = -errno;
+		goto journal_open_error;
+	}
+	return 0;
+
+	journal_open_error:
+	close(j->fd);
+	j->fd = -1;
+	return r;
+}
+
+// one record, formatted on the stack or in heap memory when it does not fit
+static int journal_write(struct journal *j, const char *fmt, ...)
+{
+	char buf[256];
+	char *s = buf;
+	const char *b;
+	va_list ap;
+	ssize_t n;
+	int len, r;
+
+	if (j->fd < 0)
+		return -EBADF;
+
+	va_start(ap, fmt);
+	len = vsnprintf(buf, sizeof(buf), fmt, ap);
+	va_end(ap);
+	if (len < 0)
+		return -EINVAL;
+
+	if ((size_t) len >= sizeof(buf))
+	{
+		s = malloc(len + 1);
+		if (s == NULL)
+			return -ENOMEM;
+		va_start(ap, fmt);
+		vsnprintf(s, len + 1, fmt, ap);
+		va_end(ap);
+	}
+
+	// a short write only happens on a full disk, the rest follows it
+	r = 0;
+	for (b = s; len > 0; b += n, len -= n)
+	{
+		n = write(j->fd, b, len);
+		if ((n < 0) && (errno == EINTR))
+			n = 0;
+		else if (n < 0)
+		{
+			r = -errno;
+			break;
+		}
+	}
+
+	if (s != buf)
+		free(s);
+	return r;
+}
+
+int journal_args(struct journal *j, int rig, const char *words)
+{
+	return journal_write(j, "args %d %s\n", rig, words);
+}
+
+int journal_start(struct journal *j, int64_t t, int resumed)
+{
+	return journal_write(j, "%s %" PRId64 "\n", resumed ? "resume" : "start", t);
+}
+
+int journal_plan(struct journal *j, const struct journal_plan *p)
+{
+	return journal_write(j, "plan %d %.17g %.17g %d %d\n",
+		p->stage, p->V_start, p->V_stop, p->reversed, p->last);
+}
+
+int journal_point(struct journal *j, const struct journal_point *p)
+{
+	return journal_write(j, "point %d %d %.17g %.17g %" PRId64 " %" PRIu64 "\n",
+		p->index, p->stage, p->voltage, p->time, p->dat_size, p->bin_records);
+}
+
+void journal_close(struct journal *j)
+{
+	if (j->fd >= 0)
+		close(j->fd);
+	j->fd = -1;
+}
+
+// === reader
+static int journal_split(struct journal_state *s, const char *words)
+{
+	char *save, *w;
+
+	free(s->args);
+	s->args = strdup(words);
+	if (s->args == NULL)
+		return -ENOMEM;
+
+	s->argv[0] = "fet4p";
+	s->argc = 1;
+	for (w = strtok_r(s->args, " \t\r\n", &save); w != NULL; w = strtok_r(NULL, " \t\r\n", &save))
+	{
+		if (s->argc == JOURNAL_ARGS + 1)
+			return -E2BIG;
+		s->argv[s->argc++] = w;
+	}
+	s->argv[s->argc] = NULL;
+
+	return 0;
+}
+
+int journal_read(struct journal_state *s, const char *path)
+{
+	struct journal_plan  pl;
+	struct journal_point pt;
+	char *line = NULL;
+	size_t len = 0;
+	ssize_t n;
+	int64_t t;
+	int started = 0;
+	int k, r = 0;
+	FILE *fp;
+
+	memset(s, 0, sizeof(struct journal_state));
+
+	fp = fopen(path, "r");
+	if (fp == NULL)
+		return -errno;
+
+	while ((n = getline(&line, &len, fp)) != -1)
+	{
+		// the line the process was killed in
+		if (line[n - 1] != '\n')
+			break;
+
+		if (sscanf(line, "args %d %n", &s->rig, &k) == 1)
+		{
+			r = journal_split(s, line + k);
+			if (r < 0)
+				break;
+		}
+		else if (sscanf(line, "start %" SCNd64, &t) == 1)
+		{
+			s->start_time = t;
+			started = 1;
+		}
+		else if (sscanf(line, "plan %d %lf %lf %d %d",
+			&pl.stage, &pl.V_start, &pl.V_stop, &pl.reversed, &pl.last) == 5)
+		{
+			s->plan = pl;
+			s->plans++;
+		}
+		else if (sscanf(line, "point %d %d %lf %lf %" SCNd64 " %" SCNu64,
+			&pt.index, &pt.stage, &pt.voltage, &pt.time, &pt.dat_size, &pt.bin_records) == 6)
+		{
+			s->point = pt;
+			s->points++;
+		}
+	}
+	free(line);
+	fclose(fp);
+
+	if ((r == 0) && ((s->args == NULL) || !started))
+		r = -EINVAL;
+	if (r < 0)
+		journal_free(s);
+	return r;
+}
+
+void journal_free(struct journal_state *s)
+{
+	free(s->args);
+	s->args = NULL;
+	s->argc = 0;
+}
@@ -0,0 +1,82 @@
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include <stdint.h>
+
+// === [JOURNAL] ===
+#define JOURNAL_FILE   "journal.txt"
+#define JOURNAL_PERIOD 0.5 // minimum time between point commits, s
+#define JOURNAL_ARGS   256 // words of the run arguments
+
+// journal.txt is an append-only text file, a record is one line written by
+// a single write(2) on an O_APPEND descriptor, so the worker and the sink
+// thread may both append and a killed process leaves at most a partial last
+// line, which the reader ignores; there is no fsync, the journal survives
+// the process and not the machine
+//   args <rig> <word>...   options and sample names of the run, split at
+//                          whitespace like a recipe line, rig is the index
+//                          of the instrument of this directory
+//   start <unix time>      start of the run, time 0 of the points
+//   resume <unix time>     a resumed run continues here
+//   plan <stage> <V_start> <V_stop> <reversed> <last>
+//                          sweep compiled from <stage> on after the point
+//                          <last>, -1 before the first point
+//   point <index> <stage> <voltage> <time> <dat_size> <bin_records>
+//                          vac.dat has <dat_size> bytes and vac.bin
+//                          <bin_records> records up to and including the
+//                          point <index> at the scanning <voltage>, index -1
+//                          is the header alone
+// a resumed run reads the last plan and point records
+
+struct journal
+{
+	int fd;
+};
+
+struct journal_plan
+{
+	int    stage;
+	double V_start;
+	double V_stop;
+	int    reversed;
+	int    last;
+};
+
+struct journal_point
+{
+	int      index;
+	int      stage;
+	double   voltage;
+	double   time;
+	int64_t  dat_size;
+	uint64_t bin_records;
+};
+
+// what a run left in its journal
+struct journal_state
+{
+	char   *args; // the words of argv point into it
+	char   *argv[JOURNAL_ARGS + 2];
+	int     argc; // argv[0] is the program name
+	int     rig;
+	int64_t start_time;
+	int     plans;
+	struct journal_plan  plan;
+	int     points;
+	struct journal_point point;
+};
+
+// writer, append continues the journal of a resumed run after its last
+// complete line
+int  journal_open(struct journal *j, const char *path, int append);
+int  journal_args(struct journal *j, int rig, const char *words);
+int  journal_start(struct journal *j, int64_t t, int resumed);
+int  journal_plan(struct journal *j, const struct journal_plan *p);
+int  journal_point(struct journal *j, const struct journal_point *p);
+void journal_close(struct journal *j);
+
+// reader, returns -EINVAL without the args and start records
+int  journal_read(struct journal_state *s, const char *path);
+void journal_free(struct journal_state *s);
+
+#endif
@@ -0,0 +1,103 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <string.h>
+#include <time.h>
+
+#include "latency.h"
+
+uint64_t lat_now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+void lat_reset(struct lat_hist *h)
+{
+	memset(h, 0, sizeof(struct lat_hist));
+}
+
+static int lat_index(uint64_t v)
+{
+	int e, idx;
+
+	if (v < LAT_SUB)
+		return v;
+
+	e   = 63 - __builtin_clzll(v);
+	idx = (e - LAT_SUB_BITS + 1) * LAT_SUB + ((v >> (e - LAT_SUB_BITS)) & (LAT_SUB - 1));
+
+	return (idx < LAT_BUCKETS) ? idx : LAT_BUCKETS - 1;
+}
+
+// middle of the bucket
+static uint64_t lat_value(int idx)
+{
+	int e, sub;
+
+	if (idx < LAT_SUB)
+		return idx;
+
+	e   = idx / LAT_SUB + LAT_SUB_BITS - 1;
+	sub = idx % LAT_SUB;
+
+	return (((uint64_t) (LAT_SUB + sub)) << (e - LAT_SUB_BITS)) + (((uint64_t) 1 << (e - LAT_SUB_BITS)) >> 1);
+}
+
+void lat_record(struct lat_hist *h, uint64_t ns)
+{
+	if ((h->count == 0) || (ns < h->min))
+		h->min = ns;
+	if (ns > h->max)
+		h->max = ns;
+	h->count++;
+	h->total += ns;
+	h->bucket[lat_index(ns)]++;
+}
+
+uint64_t lat_percentile(const struct lat_hist *h, double p)
+{
+	uint64_t rank;
+	uint64_t seen = 0;
+	uint64_t v;
+	int k;
+
+	if (h->count == 0)
+		return 0;
+
+	rank = p * h->count;
+	if (rank < 1)
+		rank = 1;
+
+	for (k = 0; k < LAT_BUCKETS; k++)
+	{
+		seen += h->bucket[k];
+		if (seen >= rank)
+			break;
+	}
+
+	v = lat_value(k);
+	if (v > h->max) v = h->max;
+	if (v < h->min) v = h->min;
+	return v;
+}
+
+void lat_print_header(FILE *fp)
+{
+	fprintf(fp, "# %-10s %10s %12s %12s %12s %12s %14s\n",
+		"phase", "count", "min, ms", "p50, ms", "p99, ms", "max, ms", "total, ms");
+}
+
+void lat_print(FILE *fp, const char *name, const struct lat_hist *h)
+{
+	fprintf(fp, "  %-10s %10" PRIu64 " %12.3lf %12.3lf %12.3lf %12.3lf %14.3lf\n",
+		name,
+		h->count,
+		h->min / 1e6,
+		lat_percentile(h, 0.50) / 1e6,
+		lat_percentile(h, 0.99) / 1e6,
+		h->max / 1e6,
+		h->total / 1e6
+	);
+}
@@ -0,0 +1,34 @@
+#ifndef LATENCY_H
+#define LATENCY_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+// === [LATENCY] ===
+// log-linear histogram: 16 sub-buckets per power of two of nanoseconds,
+// relative bucket width is below 6.25 % up to ~1100 s
+#define LAT_SUB_BITS 4
+#define LAT_SUB      (1 << LAT_SUB_BITS)
+#define LAT_BUCKETS  (38 * LAT_SUB)
+
+struct lat_hist
+{
+	uint64_t count;
+	uint64_t min;
+	uint64_t max;
+	uint64_t total;
+	uint32_t bucket[LAT_BUCKETS];
+};
+
+// CLOCK_MONOTONIC time, ns
+uint64_t lat_now(void);
+
+void     lat_reset(struct lat_hist *h);
+void     lat_record(struct lat_hist *h, uint64_t ns);
+uint64_t lat_percentile(const struct lat_hist *h, double p);
+
+// one summary row: name, count, min, p50, p99, max, total (ms)
+void     lat_print_header(FILE *fp);
+void     lat_print(FILE *fp, const char *name, const struct lat_hist *h);
+
+#endif
@@ -1,3 +1,4 @@
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
@@ -5,6 +6,9 @@
 #include <stdint.h>
 #include <inttypes.h>
 #include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <sys/mman.h>
 #include <sys/time.h>
 #include <sys/stat.h>
 #include <sys/types.h>
@@ -16,10 +20,51 @@
 #include <math.h>
 #include <argp.h>
 #include <error.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/eventfd.h>
+
+#include "instrument.h"
+#include "latency.h"
+#include "plot.h"
+#include "plan.h"
+#include "analyze.h"
+#include "point.h"
+#include "ring.h"
+#include "vacfile.h"
+#include "journal.h"
+#include "telemetry.h"
 
 // === [DATE] ===
+time_t start_time;
 struct tm start_time_struct;
 
+// === [RIGS] ===
+#define RIG_MAX 8 // instruments per process
+
+// === [PROFILE] ===
+#define PROFILE_LINE 50.0 // power line frequency, Hz
+
+// measurement configuration applied to both channels
+struct profile
+{
+	const char *name;
+	double nplc;          // integration time, power line cycles
+	const char *autozero; // AUTOZERO_OFF, AUTOZERO_ONCE or AUTOZERO_AUTO
+	int    filter;        // repeat average count, 0 - off
+	const char *delay;    // measure delay, DELAY_OFF or DELAY_AUTO
+};
+
+// the first entry leaves the instrument as it is, values are the 2600 defaults
+static const struct profile profiles[] =
+{
+	{"default"  , 1.0 , "AUTOZERO_AUTO", 0, "DELAY_AUTO"},
+	{"fast"     , 0.01, "AUTOZERO_ONCE", 0, "DELAY_OFF" },
+	{"balanced" , 1.0 , "AUTOZERO_AUTO", 0, "DELAY_AUTO"},
+	{"low_noise", 10.0, "AUTOZERO_AUTO", 5, "DELAY_AUTO"},
+	{NULL}
+};
+
 // === [ARGUMENTS] ===
 const char *argp_program_version = "fet4p 0.1";
 const char *argp_program_bug_address = "<killingrain@gmail.com>";
@@ -30,19 +75,57 @@ static char doc[] =
 	"TODO: This part of the documentation comes *after* the options; "
 	"note that the text is automatically filled, but it's possible "
 	"to force a line-break, e.g.\n<-- here.";
-static char args_doc[] = "SAMPLE_NAME";
+static char args_doc[] = "SAMPLE_NAME...";
 
 // Keys for options without short-options
-#define OPT_CHAN     1  // --Chan
-#define OPT_V1_START 2  // --V1_start
-#define OPT_V1_STOP  3  // --V1_stop
-#define OPT_V1_STEP  4  // --V1_step
-#define OPT_I1_MAX   5  // --I1_max
-#define OPT_V2_START 6  // --V2_start
-#define OPT_V2_STOP  7  // --V2_stop
-#define OPT_V2_STEP  8  // --V2_step
-#define OPT_I2_MAX   9  // --I2_max
-#define OPT_DELAY    10 // --delay
+#define OPT_CHAN      1  // --Chan
+#define OPT_V1_START  2  // --V1_start
+#define OPT_V1_STOP   3  // --V1_stop
+#define OPT_V1_STEP   4  // --V1_step
+#define OPT_I1_MAX    5  // --I1_max
+#define OPT_V2_START  6  // --V2_start
+#define OPT_V2_STOP   7  // --V2_stop
+#define OPT_V2_STEP   8  // --V2_step
+#define OPT_I2_MAX    9  // --I2_max
+#define OPT_DELAY     10 // --delay
+#define OPT_SEPARATE  11 // --separate
+#define OPT_ONBOARD   12 // --onboard
+#define OPT_DEV       13 // --dev
+#define OPT_SIM_LAT   14 // --sim_latency
+#define OPT_SIM_NOISE 15 // --sim_noise
+#define OPT_TIMINGS   16 // --timings
+#define OPT_FPS       17 // --fps
+#define OPT_HEADLESS  18 // --headless
+#define OPT_FORMAT    19 // --format
+#define OPT_SETTLE    20 // --settle
+#define OPT_SETTLE_TOL 21 // --settle_tol
+#define OPT_SIM_TAU   22 // --sim_tau
+#define OPT_REFINE    23 // --refine
+#define OPT_STEP_MIN  24 // --step_min
+#define OPT_REFINE_TOL 25 // --refine_tol
+#define OPT_DRY_RUN   26 // --dry_run
+#define OPT_RAMP      27 // --ramp
+#define OPT_RAMP_READ 28 // --ramp_read
+#define OPT_PROFILE   29 // --profile
+#define OPT_SAMPLES   30 // --samples
+#define OPT_SEM_TOL   31 // --sem_tol
+// printable keys would be short options too, the rest are above UCHAR_MAX
+#define OPT_SEM_ABS   256 // --sem_abs
+#define OPT_COMPLY    257 // --compliance
+#define OPT_FIT_WINDOW 258 // --fit_window
+#define OPT_GEOMETRY  259 // --geometry
+#define OPT_EARLY_STOP 260 // --early_stop
+#define OPT_TIMEOUT   261 // --timeout
+#define OPT_RETRIES   262 // --retries
+#define OPT_PIPELINE  263 // --pipeline
+#define OPT_PERIOD    264 // --period
+#define OPT_RT        265 // --rt
+#define OPT_STRESS    266 // --stress
+#define OPT_STRESS_INTERVAL 267 // --stress_interval
+#define OPT_STRESS_SWEEP 268 // --stress_sweep
+#define OPT_RECIPE    269 // --recipe
+#define OPT_RESUME    270 // --resume
+#define OPT_TELEMETRY 271 // --telemetry
 
 // The options we understand
 static struct argp_option options[] =
@@ -59,7 +142,60 @@ static struct argp_option options[] =
 	{"I2_max"  , OPT_I2_MAX  , "double", 0, "Maximum current, A (0.001 - 0.1, default 0.01)", 0},
 	{0,0,0,0, "Required:", 0},
 	{"delay"    , OPT_DELAY  , "double", 0, "Scanning delay time, s (0.1 - 10.0)"           , 0},
+	{0,0,0,0, "Settling:", 0},
+	{"settle"    , OPT_SETTLE    , 0       , 0, "Read as soon as the currents are stable, --delay is the upper bound", 0},
+	{"settle_tol", OPT_SETTLE_TOL, "double", 0, "Relative change of stable readings (0.0001 - 0.5, default 0.01)"  , 0},
+	{0,0,0,0, "Step refinement:", 0},
+	{"refine"    , OPT_REFINE    , 0       , 0, "Adapt the step to the drain current slope, the channel step is the maximum", 0},
+	{"step_min"  , OPT_STEP_MIN  , "double", 0, "Minimum voltage step, V (0.0001 - 1.0, default step / 10)"          , 0},
+	{"refine_tol", OPT_REFINE_TOL, "double", 0, "Maximum drain current change per step, decades (0.01 - 2.0, default 0.1)", 0},
+	{0,0,0,0, "Sampling:", 0},
+	{"samples"   , OPT_SAMPLES   , "int"   , 0, "Maximum readings per point, repeat until the mean currents are confident (1 - 10000, default 1)", 0},
+	{"sem_tol"   , OPT_SEM_TOL   , "double", 0, "Relative standard error of the mean currents (0.0001 - 1.0, default 0.01)", 0},
+	{"sem_abs"   , OPT_SEM_ABS   , "double", 0, "Absolute standard error of the mean currents, A (0.0 - 0.001, default 1e-12)", 0},
+	{0,0,0,0, "Analysis:", 0},
+	{"fit_window", OPT_FIT_WINDOW, "int"   , 0, "Points per sliding fit of the stage 2 curve (3 - 100, default 5)", 0},
+	{"geometry"  , OPT_GEOMETRY  , "L,W,Ci", 0, "Channel length and width, m, and gate capacitance, F/m^2, for the mobility", 0},
+	{"early_stop", OPT_EARLY_STOP, "double", 0, "End stage 2 once gm and Vth change less than this for a window (0.001 - 0.5)", 0},
+	{0,0,0,0, "Ramp:", 0},
+	{"ramp"      , OPT_RAMP      , "double", 0, "Ramp stages 1 and 3 at this slew rate without readback, V/s (0.01 - 100.0)", 0},
+	{"ramp_read" , OPT_RAMP_READ , "int"   , 0, "Read back every N-th ramp point (0 - 1000, default 0)"                    , 0},
 	{0,0,0,0, "Common:", 0},
+	{"compliance", OPT_COMPLY , "off|next|reverse", 0,
+		"On a current at its limit: keep going, end the stage like \"n\", "
+		"or retrace stage 2 to the start voltage once (default off)", 0},
+	{"separate" , OPT_SEPARATE, 0     , 0, "Read V1, I1, V2, I2 with four separate queries per point", 0},
+	{"onboard"  , OPT_ONBOARD , 0     , 0, "Run each sweep stage on the instrument (trigger model)"   , 0},
+	{"pipeline" , OPT_PIPELINE, 0     , 0, "Send the next setpoint with the readback of a point, the host work "
+		"overlaps the next settle (not with --separate)", 0},
+	{"profile"  , OPT_PROFILE , "fast|balanced|low_noise", 0,
+		"Measurement speed and noise preset: NPLC, autozero, filter, measure delay "
+		"(default: leave the instrument settings)", 0},
+	{"period"   , OPT_PERIOD  , "double", 0, "Start the measured points on a fixed grid of this period, s (0.01 - 3600.0)", 0},
+	{"rt"       , OPT_RT      , "cpu" , OPTION_ARG_OPTIONAL, "Real-time acquisition: SCHED_FIFO, locked memory, "
+		"the rig threads pinned from this CPU on", 0},
+	{"stress"         , OPT_STRESS         , "double", 0, "Hold V1_start and V2_start and log the currents from the instrument buffers for this time, s (1.0 - 1e6)", 0},
+	{"stress_interval", OPT_STRESS_INTERVAL, "double", 0, "Measure delay of a stress reading, s (0.0 - 10.0, default 0.0, as fast as the profile allows)", 0},
+	{"stress_sweep"   , OPT_STRESS_SWEEP   , "double", 0, "Interrupt the stress with a stage 2 sweep on the instrument every this time, s (1.0 - 1e6)", 0},
+	{"timings"  , OPT_TIMINGS , 0     , 0, "Dump raw per-point phase timings to timing.dat"          , 0},
+	{"dry_run"  , OPT_DRY_RUN , 0     , 0, "Print the sweep plan, point count and expected duration and exit", 0},
+	{"fps"      , OPT_FPS     , "double", 0, "Maximum plot redraw rate, 1/s (0.1 - 60.0, default 5.0)", 0},
+	{"headless" , OPT_HEADLESS, 0     , 0, "Do not start gnuplot"                                    , 0},
+	{"telemetry", OPT_TELEMETRY, "name", 0, "Publish the points and the run state of every rig in the shared memory "
+		"object /fet4p.<name>, see build/vacmon", 0},
+	{"format"   , OPT_FORMAT  , "text|bin|both", 0, "Output format: vac.dat, vac.bin or both (default text)", 0},
+	{"recipe"   , OPT_RECIPE  , "file", 0, "Run the entries of the file one after another, an entry is a line of "
+		"options and SAMPLE_NAMEs added to the command line ones", 0},
+	{"resume"   , OPT_RESUME  , "dir" , 0, "Continue the run of an experiment directory after its last committed point, "
+		"the options of its journal apply, the command line ones override them", 0},
+	{0,0,0,0, "Instrument:", 0},
+	{"dev"        , OPT_DEV      , "path"  , 0, "Instrument device file or \"sim\" (default /dev/usbtmc0), "
+		"repeat for several instruments with one SAMPLE_NAME each", 0},
+	{"sim_latency", OPT_SIM_LAT  , "double", 0, "Simulator response latency, s (0.0 - 1.0, default 0.001)"  , 0},
+	{"sim_noise"  , OPT_SIM_NOISE, "double", 0, "Simulator relative current noise (0.0 - 1.0, default 0.01)", 0},
+	{"sim_tau"    , OPT_SIM_TAU  , "double", 0, "Simulator current settling time, s (0.0 - 10.0, default 0.02)", 0},
+	{"timeout"    , OPT_TIMEOUT  , "double", 0, "Response deadline per query, s (0.1 - 600.0, default 5.0)"    , 0},
+	{"retries"    , OPT_RETRIES  , "int"   , 0, "Repeats of a query that timed out (0 - 10, default 2)"        , 0},
 	{0}
 };
 
@@ -67,7 +203,8 @@ static struct argp_option options[] =
 struct arguments
 {
 	int    sample_name_flag;
-	char  *sample_name;
+	char  *sample_name[RIG_MAX];
+	int    sample_names;
 	int    Chan;
 	double V1_start;
 	double V1_stop;
@@ -79,8 +216,58 @@ struct arguments
 	double I2_max;
 	int    Delay_flag;
 	double Delay;
+	int    Separate;
+	int    Onboard;
+	int    Pipeline;
+	double Period;
+	int    Rt;
+	int    Rt_cpu;
+	double Stress;
+	double Stress_interval;
+	double Stress_sweep;
+	char  *Recipe;
+	int    Entry; // line of the recipe file, 0 - not from a recipe
+	char  *Words; // options and sample names of the entry, for the journal
+	char  *Resume;
+	char  *Telemetry;
+	char  *Dev[RIG_MAX];
+	int    Devs;
+	double Sim_latency;
+	double Sim_noise;
+	double Sim_tau;
+	int    Timings;
+	double Fps;
+	int    Headless;
+	int    Format;
+	int    Settle;
+	double Settle_tol;
+	int    Refine;
+	double Step_min;
+	double Refine_tol;
+	int    Dry_run;
+	double Ramp;
+	int    Ramp_read;
+	const struct profile *Profile;
+	int    Samples;
+	double Sem_tol;
+	double Sem_abs;
+	int    Compliance;
+	int    Fit_window;
+	double Mu_k;
+	double Early_stop;
+	double Timeout;
+	int    Retries;
 };
 
+// compliance policies
+#define COMPLY_OFF     0
+#define COMPLY_NEXT    1
+#define COMPLY_REVERSE 2
+
+// output formats
+#define FMT_TEXT 1 // vac.dat
+#define FMT_BIN  2 // vac.bin
+
 static error_t parse_opt (int key, char *arg, struct argp_state *state)
 {
 	struct arguments *a = state->input;
@@ -180,11 +367,307 @@ static error_t parse_opt (int key, char *arg, struct argp_state *state)
 			a->Delay = t;
 			a->Delay_flag = 1;
 			break;
+		case OPT_SEPARATE:
+			a->Separate = 1;
+			break;
+		case OPT_ONBOARD:
+			a->Onboard = 1;
+			break;
+		case OPT_PIPELINE:
+			a->Pipeline = 1;
+			break;
+		case OPT_PERIOD:
+			t = atof(arg);
+			if ((t < 0.01) || (t > 3600.0))
+			{
+				fprintf(stderr, "# E: <period> is out of range. See \"fet4p --help\"\n");
+				return ARGP_ERR_UNKNOWN;
+			}
+			a->Period = t;
+			break;
+		case OPT_RT:
+			a->Rt = 1;
+			if (arg != NULL)
+			{
+				i = atoi(arg);
+				if ((i < 0) || (i >= CPU_SETSIZE))
+				{
+					fprintf(stderr, "# E: <rt> is out of range. See \"fet4p --help\"\n");
+					return ARGP_ERR_UNKNOWN;
+				}
+				a->Rt_cpu = i;
+			}
+			break;
+		case OPT_STRESS:
+			t = atof(arg);
+			if ((t < 1.0) || (t > 1e6))
+			{
+				fprintf(stderr, "# E: <stress> is out of range. See \"fet4p --help\"\n");
+				return ARGP_ERR_UNKNOWN;
+			}
+			a->Stress = t;
+			break;
+		case OPT_STRESS_INTERVAL:
+			t = atof(arg);
+			if ((t < 0.0) || (t > 10.0))
+			{
+				fprintf(stderr, "# E: <stress_interval> is out of range. See \"fet4p --help\"\n");
+				return ARGP_ERR_UNKNOWN;
+			}
+			a->Stress_interval = t;
+			break;
+		case OPT_STRESS_SWEEP:
+			t = atof(arg);
+			if ((t < 1.0) || (t > 1e6))
+			{
+				fprintf(stderr, "# E: <stress_sweep> is out of range. See \"fet4p --help\"\n");
+				return ARGP_ERR_UNKNOWN;
+			}
+			a->Stress_sweep = t;
+			break;
+		case OPT_DEV:
+			if (a->Devs == RIG_MAX)
+			{
+				fprintf(stderr, "# E: Too many <dev> options (%d max). See \"fet4p --help\"\n", RIG_MAX);
+				return ARGP_ERR_UNKNOWN;
+			}
+			a->Dev[a->Devs++] = arg;
+			break;
+		case OPT_TIMINGS:
+			a->Timings = 1;
+			break;
+		case OPT_FPS:
+			t = atof(arg);
+			if ((t < 0.1) || (t > 60.0))
+			{
+				fprintf(stderr, "# E: <fps> is out of range. See \"fet4p --help\"\n");
+				return ARGP_ERR_UNKNOWN;
+			}
+			a->Fps = t;
+			break;
+		case OPT_HEADLESS:
+			a->Headless = 1;
+			break;
+		case OPT_PROFILE:
+			for (i = 1; profiles[i].name != NULL; i++)
+				if (strcmp(arg, profiles[i].name) == 0)
+					break;
+			if (profiles[i].name == NULL)
+			{
+				fprintf(stderr, "# E: <profile> is out of range. See \"fet4p --help\"\n");
+				return ARGP_ERR_UNKNOWN;
+			}
+			a->Profile = &profiles[i];
+			break;
+		case OPT_FIT_WINDOW:
+			i = atoi(arg);
+			if ((i < 3) || (i > FIT_WINDOW_MAX))
+			{
+				fprintf(stderr, "# E: <fit_window> is out of range. See \"fet4p --help\"\n");
+				return ARGP_ERR_UNKNOWN;
+			}
+			a->Fit_window = i;
+			break;
+		case OPT_GEOMETRY:
+			{
+				double L, W, C;
+
+				if ((sscanf(arg, "%lf,%lf,%lf", &L, &W, &C) != 3) || (L <= 0) || (W <= 0) || (C <= 0))
+				{
+					fprintf(stderr, "# E: <geometry> is out of range. See \"fet4p --help\"\n");
+					return ARGP_ERR_UNKNOWN;
+				}
+				a->Mu_k = L / (W * C);
+			}
+			break;
+		case OPT_EARLY_STOP:
+			t = atof(arg);
+			if ((t < 0.001) || (t > 0.5))
+			{
+				fprintf(stderr, "# E: <early_stop> is out of range. See \"fet4p --help\"\n");
+				return ARGP_ERR_UNKNOWN;
+			}
+			a->Early_stop = t;
+			break;
+		case OPT_COMPLY:
+			if (strcmp(arg, "off") == 0)
+				a->Compliance = COMPLY_OFF;
+			else if (strcmp(arg, "next") == 0)
+				a->Compliance = COMPLY_NEXT;
+			else if (strcmp(arg, "reverse") == 0)
+				a->Compliance = COMPLY_REVERSE;
+			else
+			{
+				fprintf(stderr, "# E: <compliance> is out of range. See \"fet4p --help\"\n");
+				return ARGP_ERR_UNKNOWN;
+			}
+			break;
+		case OPT_RECIPE:
+			a->Recipe = arg;
+			break;
+		case OPT_RESUME:
+			a->Resume = arg;
+			break;
+		case OPT_TELEMETRY:
+			if ((strlen(arg) == 0) || (strlen(arg) > 200) || (strchr(arg, '/') != NULL))
+			{
+				fprintf(stderr, "# E: <telemetry> is not a name without \"/\". See \"fet4p --help\"\n");
+				return ARGP_ERR_UNKNOWN;
+			}
+			a->Telemetry = arg;
+			break;
+		case OPT_FORMAT:
+			if (strcmp(arg, "text") == 0)
+				a->Format = FMT_TEXT;
+			else if (strcmp(arg, "bin") == 0)
+				a->Format = FMT_BIN;
+			else if (strcmp(arg, "both") == 0)
+				a->Format = FMT_TEXT | FMT_BIN;
+			else
+			{
+				fprintf(stderr, "# E: <format> is out of range. See \"fet4p --help\"\n");
+				return ARGP_ERR_UNKNOWN;
+			}
+			break;
+		case OPT_SIM_LAT:
+			t = atof(arg);
+			if ((t < 0.0) || (t > 1.0))
+			{
+				fprintf(stderr, "# E: <sim_latency> is out of range. See \"fet4p --help\"\n");
+				return ARGP_ERR_UNKNOWN;
+			}
+			a->Sim_latency = t;
+			break;
+		case OPT_SIM_NOISE:
+			t = atof(arg);
+			if ((t < 0.0) || (t > 1.0))
+			{
+				fprintf(stderr, "# E: <sim_noise> is out of range. See \"fet4p --help\"\n");
+				return ARGP_ERR_UNKNOWN;
+			}
+			a->Sim_noise = t;
+			break;
+		case OPT_SIM_TAU:
+			t = atof(arg);
+			if ((t < 0.0) || (t > 10.0))
+			{
+				fprintf(stderr, "# E: <sim_tau> is out of range. See \"fet4p --help\"\n");
+				return ARGP_ERR_UNKNOWN;
+			}
+			a->Sim_tau = t;
+			break;
+		case OPT_TIMEOUT:
+			t = atof(arg);
+			if ((t < 0.1) || (t > 600.0))
+			{
+				fprintf(stderr, "# E: <timeout> is out of range. See \"fet4p --help\"\n");
+				return ARGP_ERR_UNKNOWN;
+			}
+			a->Timeout = t;
+			break;
+		case OPT_RETRIES:
+			i = atoi(arg);
+			if ((i < 0) || (i > 10))
+			{
+				fprintf(stderr, "# E: <retries> is out of range. See \"fet4p --help\"\n");
+				return ARGP_ERR_UNKNOWN;
+			}
+			a->Retries = i;
+			break;
+		case OPT_SETTLE:
+			a->Settle = 1;
+			break;
+		case OPT_REFINE:
+			a->Refine = 1;
+			break;
+		case OPT_DRY_RUN:
+			a->Dry_run = 1;
+			break;
+		case OPT_STEP_MIN:
+			t = atof(arg);
+			if ((t < 0.0001) || (t > 1.0))
+			{
+				fprintf(stderr, "# E: <step_min> is out of range. See \"fet4p --help\"\n");
+				return ARGP_ERR_UNKNOWN;
+			}
+			a->Step_min = t;
+			break;
+		case OPT_REFINE_TOL:
+			t = atof(arg);
+			if ((t < 0.01) || (t > 2.0))
+			{
+				fprintf(stderr, "# E: <refine_tol> is out of range. See \"fet4p --help\"\n");
+				return ARGP_ERR_UNKNOWN;
+			}
+			a->Refine_tol = t;
+			break;
+		case OPT_RAMP:
+			t = atof(arg);
+			if ((t < 0.01) || (t > 100.0))
+			{
+				fprintf(stderr, "# E: <ramp> is out of range. See \"fet4p --help\"\n");
+				return ARGP_ERR_UNKNOWN;
+			}
+			a->Ramp = t;
+			break;
+		case OPT_RAMP_READ:
+			i = atoi(arg);
+			if ((i < 0) || (i > 1000))
+			{
+				fprintf(stderr, "# E: <ramp_read> is out of range. See \"fet4p --help\"\n");
+				return ARGP_ERR_UNKNOWN;
+			}
+			a->Ramp_read = i;
+			break;
+		case OPT_SAMPLES:
+			i = atoi(arg);
+			if ((i < 1) || (i > 10000))
+			{
+				fprintf(stderr, "# E: <samples> is out of range. See \"fet4p --help\"\n");
+				return ARGP_ERR_UNKNOWN;
+			}
+			a->Samples = i;
+			break;
+		case OPT_SEM_TOL:
+			t = atof(arg);
+			if ((t < 0.0001) || (t > 1.0))
+			{
+				fprintf(stderr, "# E: <sem_tol> is out of range. See \"fet4p --help\"\n");
+				return ARGP_ERR_UNKNOWN;
+			}
+			a->Sem_tol = t;
+			break;
+		case OPT_SEM_ABS:
+			t = atof(arg);
+			if ((t < 0.0) || (t > 0.001))
+			{
+				fprintf(stderr, "# E: <sem_abs> is out of range. See \"fet4p --help\"\n");
+				return ARGP_ERR_UNKNOWN;
+			}
+			a->Sem_abs = t;
+			break;
+		case OPT_SETTLE_TOL:
+			t = atof(arg);
+			if ((t < 0.0001) || (t > 0.5))
+			{
+				fprintf(stderr, "# E: <settle_tol> is out of range. See \"fet4p --help\"\n");
+				return ARGP_ERR_UNKNOWN;
+			}
+			a->Settle_tol = t;
+			break;
 		case ARGP_KEY_ARG:
-			a->sample_name = arg;
+			if (a->sample_names == RIG_MAX)
+			{
+				fprintf(stderr, "# E: Too many <sample_name> arguments (%d max). See \"fet4p --help\"\n", RIG_MAX);
+				return ARGP_ERR_UNKNOWN;
+			}
+			a->sample_name[a->sample_names++] = arg;
 			a->sample_name_flag = 1;
 			break;
 		case ARGP_KEY_NO_ARGS:
+			// the sample names are given by the recipe entries or the journal
+			if (((a->Recipe != NULL) && (a->Entry == 0)) || (a->Resume != NULL))
+				break;
 			fprintf(stderr, "# E: <sample_name> has not specified. See \"fet4p --help\"\n");
 			a->sample_name_flag = 0;
 			//argp_usage (state);
@@ -197,8 +680,27 @@ static error_t parse_opt (int key, char *arg, struct argp_state *state)
 
 static struct argp argp = {options, parse_opt, args_doc, doc, NULL, NULL, NULL};
 
-// === [INSTRUMENT] ===
-#define INS_DEV_FILE "/dev/usbtmc0"
+// === [ONBOARD] ===
+#define ONBOARD_POLL  0.1  // buffer polling period, s
+#define ONBOARD_CHUNK 100  // maximum points per printbuffer() call
+#define ONBOARD_LIST  20   // list entries per command line
+
+// === [SETTLE] ===
+#define SETTLE_TOL   0.01  // relative change between consecutive readings
+#define SETTLE_FLOOR 1e-10 // absolute change treated as stable, A
+
+// === [REFINE] ===
+#define REFINE_DIV   10    // default minimum step is the channel step / REFINE_DIV
+#define REFINE_TOL   0.1   // drain current change per step, decades
+#define REFINE_FLOOR 1e-12 // added to |I| before taking the log, A
+
+// === [SAMPLE] ===
+#define SAMPLE_MIN 3     // readings before the standard error is trusted
+#define SAMPLE_TOL 0.01  // relative standard error of the mean
+#define SAMPLE_ABS 1e-12 // absolute standard error of the mean, A
+
+// === [COMPLIANCE] ===
+#define COMPLY_FRAC 0.99 // |I| above this fraction of I_max is at the limit
 
 // === [SOURCE] ===
 #define CHAN     1
@@ -210,6 +712,115 @@ static struct argp argp = {options, parse_opt, args_doc, doc, NULL, NULL, NULL};
 #define V2_STOP  1.0
 #define V2_STEP  0.1
 #define I2_MAX   0.01
+#define V_LIMIT  5.0 // source voltage limit, V
+
+// === [PACE] ===
+#define PACE_SLEEP 0.002 // last part of a wait slept without watching for "q" and "n", s
+#define RT_PRIO    50    // SCHED_FIFO priority of the rig threads
+
+// === [STRESS] ===
+#define STRESS_STAGE 0      // stage of the stress points
+#define STRESS_RING  50000  // readings kept in the buffer window, below the nvbuffer capacity
+#define STRESS_CHUNK 500    // maximum readings per printbuffer() call
+#define STRESS_POLL  0.05   // buffer polling period, s
+#define STRESS_PLOT  5000   // stress points plotted over the whole run
+
+// === [ETA] ===
+#define ETA_RAMP 1.0  // final ramp down, s
+
+// === per-point phase timing ===
+enum phase
+{
+	PH_LEVEL = 0,
+	PH_SETTLE,
+	PH_READ_V1,
+	PH_READ_I1,
+	PH_READ_V2,
+	PH_READ_I2,
+	PH_READ,
+	PH_PUSH,
+	PH_POINT,
+	PH_LAG,   // paced start behind its deadline
+	PH_FILE,  // sink thread, per batch
+	PH_PLOT,  // sink thread, per batch
+	PH_COUNT
+};
+
+// phases recorded per point by the acquisition thread
+#define PH_WORKER PH_FILE
+
+static const char *phase_name[PH_COUNT] =
+{
+	"level", "settle", "read_v1", "read_i1", "read_v2", "read_i2", "read", "push", "point", "lag", "file", "plot"
+};
+
+struct sink;
+
+// settings of the init block last sent to an instrument
+struct rig_setup
+{
+	int    valid;
+	double I1_max;
+	double I2_max;
+	const struct profile *profile;
+};
+
+// one instrument with its sample, directory, output files and worker thread
+struct rig
+{
+	int          id;
+	const char  *dev;
+	const char  *sample_name;
+	char         dir[200];
+	char         filename_vac[250];
+	char         filename_bin[250];
+	pthread_t    thread;
+
+	// open across the entries of a recipe
+	struct instrument ins;
+	int          ins_open;
+	struct rig_setup setup;
+
+	atomic_int   next;
+	atomic_int   converged; // early stop of stage 2, set by the sink thread
+	int          event_fd; // signalled on "quit" and "next stage" requests
+
+	// outputs, written by the sink thread
+	struct ring  ring;
+	char        *vac_header;
+	size_t       vac_header_len;
+	FILE        *vac_fp;
+	struct vacbin bin_file;
+	struct vacbin *bin;
+	struct sink *sink;
+
+	// time of the first point, CLOCK_MONOTONIC
+	int          time_first;
+	uint64_t     time_t0;
+
+	// paced points started past their slot
+	uint64_t     overruns;
+
+	// time of the next plotted stress point, sink thread
+	double       plot_next;
+
+	// journal.txt, the plan records are written by the worker, the point
+	// records by the sink thread once the files hold the point
+	struct journal journal;
+	int          last_index; // last point handed to the sink, worker
+	struct point commit;     // last point written to the files
+	int          uncommitted;
+	uint64_t     t_commit;
+
+	// stage 2 parameters, updated by the sink thread
+	struct analyze analyze;
+
+	// per-point phase timing, the sink thread records its phases in their
+	// histograms alone, phase_ns belongs to the worker
+	struct lat_hist phase_hist[PH_COUNT];
+	uint64_t     phase_ns[PH_WORKER];
+	FILE        *timing_fp;
+};
 
 // === threads ====
 static void *commander(void *);
@@ -218,19 +829,98 @@ static void *worker(void *);
 // === utils ===
 static int get_run();
 static void set_run(int run_new);
-static int get_next();
-static void set_next(int next_new);
-static double get_time();
+static int get_next(struct rig *rig);
+static void set_next(struct rig *rig, int next_new);
+static int take_converged(struct rig *rig, int stage);
+static int wait_until(struct rig *rig, uint64_t deadline);
+static int wait_delay(struct rig *rig, double t);
+static int pace_point(struct rig *rig, uint64_t *deadline);
+static void rt_enter(struct rig *rig);
+static void on_sigint(int sig);
+static double get_time(struct rig *rig);
 
 static int direction(double start, double stop);
+static int pipelined(void);
+static int read_point(struct rig *rig, struct instrument *ins, double next, double *V1, double *I1, double *V2, double *I2);
+static int read_value(struct rig *rig, struct instrument *ins, const char *cmd, double *value, int ph);
+static int settle_point(struct rig *rig, struct instrument *ins, uint64_t t_level, double *settle);
+static int sample_point(struct rig *rig, struct instrument *ins, int n_max, double next, struct point *p);
+static int comply_point(struct point *p);
+static double refine_unit(double V_step, int *inc_max);
+static int refine_step(double I_prev, double I, int inc, int inc_max);
+static int plan_next(struct rig *rig, struct plan *plan, int stage, double voltage, double *V_start, double *V_stop, double V_step);
+static int plan_reverse(struct rig *rig, struct plan *plan, double voltage, double *V_start, double *V_stop, double V_step);
+
+static void profile_apply(struct instrument *ins, const char *smu);
+static double profile_read_time(void);
+static int  plan_summary(FILE *fp, int points);
+static int  rig_open(struct rig *rig);
+static int  rig_reopen(struct rig *rig);
+static void rig_close(struct rig *rig);
+static void rig_shutdown(struct rig *rig);
+static int  entry_open(const char **names);
+static void plot_range(int *xcol, double *xmin, double *xmax);
+static int  recipe_load(const char *filename, const struct arguments *base, struct arguments **entries);
+static char *words_join(const char *head, int argc, char **argv);
+static int  resume_load(const struct arguments *defaults, int argc, char **argv);
+static int  resume_point(const struct plan *plan);
+static int  resume_ramp(struct rig *rig, struct instrument *ins, double target, double V_step);
+static void rig_plan(struct rig *rig, int stage, double V_start, double V_stop, int reversed);
+static void rig_commit(struct rig *rig);
+
+// === output sink ===
+// the sink thread owns the output files of all rigs and the plot while the
+// acquisition runs, every rig has its own ring
+#define SINK_BATCH     256   // points per batch
+#define SINK_POLL      0.002 // idle polling period, s
+#define SINK_BIN_FLUSH 1.0   // vac.bin flush period when idle, s
+
+struct sink
+{
+	struct rig  *rigs;
+	int          nrigs;
+	struct plot *plot;
+	pthread_t    thread;
+	atomic_int   stop;
+	atomic_int   pause; // 1 - requested, 2 - rings drained and idle
+	atomic_int   error; // set by the sink thread, read by the workers
+};
+
+static int  sink_start(struct sink *sink, struct rig *rigs, int nrigs, struct plot *plot);
+static void sink_stop(struct sink *sink);
+static void sink_pause(struct sink *sink);
+static void sink_resume(struct sink *sink);
+static void *sink_thread(void *a);
+static void sink_batch(struct sink *sink, struct rig *rig, const struct point *p, size_t n);
+static int  output_point(struct rig *rig, const struct point *p);
+
+static void onboard_arm(struct instrument *ins);
+static void onboard_disarm(struct instrument *ins);
+static int sweep_onboard(struct rig *rig, struct instrument *ins, struct plan *plan, int k, int reversed, double V_start, double V_stop, double V_step, int *vac_index);
+static int onboard_segment(struct rig *rig, struct instrument *ins, int stage, const struct plan_point *list, int n, int *vac_index, double *voltage);
+static int ramp_segment(struct rig *rig, struct instrument *ins, int stage, const struct plan_point *list, int n, int *vac_index, double *voltage);
+static void stress_arm(struct instrument *ins);
+static void stress_disarm(struct instrument *ins);
+static int stress_run(struct rig *rig, struct instrument *ins, double V_start, double V_stop, double V_step, int *vac_index);
+static int stress_segment(struct rig *rig, struct instrument *ins, double t_stop, int *vac_index);
 
 // === global variables
-static char dir_str[200];
-static pthread_rwlock_t run_lock;
-static int run;
-static pthread_rwlock_t next_lock;
-static int next;
-static char filename_vac[250];
+static atomic_int run;
+static struct rig rigs[RIG_MAX];
+static int nrigs;
+
+// journal of the directory of a resumed run
+static struct journal_state resume;
+
+// shared memory of --telemetry, written by the workers
+static struct telemetry telemetry;
+
+static void phase_mark(struct rig *rig, int ph, uint64_t *t);
+static int  timing_open(struct rig *rig);
+static void timing_point(struct rig *rig, int vac_index);
+static void timing_summary(struct rig *rig);
+static void analyze_open(struct rig *rig);
+static void analyze_summary(struct rig *rig);
 struct arguments arg = {0};
 
 // === measurements ===
@@ -252,15 +942,26 @@ int main(int argc, char const *argv[])
 	int ret = 0;
 	int status;
 
-	time_t start_time;
-	struct tm start_time_struct;
-
 	pthread_t t_commander;
-	pthread_t t_worker;
+
+	struct sigaction sa;
+
+	struct rig *rig;
+	const char *names[RIG_MAX];
+	struct plot plot;
+	struct sink sink = {0};
+	struct arguments defaults;
+	struct arguments single;
+	struct arguments *entries = NULL;
+	char *words = NULL;
+	int nentries;
+	int xcol;
+	double xmin, xmax;
+	int e, k;
 
 	// === parse input parameters
 	arg.sample_name_flag = 0;
-	arg.sample_name      = NULL;
+	arg.sample_names     = 0;
 	arg.Chan             = CHAN;
 	arg.V1_start         = V1_START;
 	arg.V1_stop          = V1_STOP;
@@ -272,18 +973,108 @@ int main(int argc, char const *argv[])
 	arg.I2_max           = I2_MAX;
 	arg.Delay_flag       = 0;
 	arg.Delay            = 0.0;
-
+	arg.Separate         = 0;
+	arg.Onboard          = 0;
+	arg.Pipeline         = 0;
+	arg.Period           = 0.0;
+	arg.Rt               = 0;
+	arg.Rt_cpu           = -1;
+	arg.Stress           = 0.0;
+	arg.Stress_interval  = 0.0;
+	arg.Stress_sweep     = 0.0;
+	arg.Recipe           = NULL;
+	arg.Entry            = 0;
+	arg.Words            = NULL;
+	arg.Resume           = NULL;
+	arg.Telemetry        = NULL;
+	arg.Devs             = 0;
+	arg.Sim_latency      = SIM_LATENCY;
+	arg.Sim_noise        = SIM_NOISE;
+	arg.Timings          = 0;
+	arg.Fps              = PLOT_FPS;
+	arg.Headless         = 0;
+	arg.Format           = FMT_TEXT;
+	arg.Settle           = 0;
+	arg.Settle_tol       = SETTLE_TOL;
+	arg.Sim_tau          = SIM_TAU;
+	arg.Refine           = 0;
+	arg.Step_min         = 0.0;
+	arg.Refine_tol       = REFINE_TOL;
+	arg.Dry_run          = 0;
+	arg.Ramp             = 0.0;
+	arg.Ramp_read        = 0;
+	arg.Profile          = &profiles[0];
+	arg.Samples          = 1;
+	arg.Sem_tol          = SAMPLE_TOL;
+	arg.Sem_abs          = SAMPLE_ABS;
+	arg.Compliance       = COMPLY_OFF;
+	arg.Fit_window       = FIT_WINDOW;
+	arg.Mu_k             = 0.0;
+	arg.Early_stop       = 0.0;
+	arg.Timeout          = INS_TIMEOUT;
+	arg.Retries          = INS_RETRIES;
+
+	defaults = arg;
 	status = argp_parse(&argp, argc, argv, 0, 0, &arg);
-	if ((status != 0) || (arg.sample_name_flag != 1) || (arg.Delay_flag != 1))
+	if ((status != 0) || ((arg.Recipe == NULL) && (arg.Resume == NULL) &&
+		((arg.sample_name_flag != 1) || (arg.Delay_flag != 1))))
 	{
 		fprintf(stderr, "# E: Error while parsing. See \"fet4p --help\"\n");
 		ret = -1;
 		goto main_exit;
 	}
 
+	// === a resumed run is the one rig of its directory, otherwise the
+	// journals keep the words of the command line
+	if (arg.Resume != NULL)
+	{
+		if (resume_load(&defaults, argc, (char **) argv) < 0)
+		{
+			ret = -1;
+			goto main_exit;
+		}
+	}
+	else
+	{
+		arg.Words = words = words_join(NULL, argc - 1, (char **) argv + 1);
+		if (words == NULL)
+		{
+			fprintf(stderr, "# E: Unable to parse arguments (%s)\n", strerror(ENOMEM));
+			ret = -1;
+			goto main_exit;
+		}
+	}
+
+	// === one sample name per instrument, the instruments are the same for
+	// every recipe entry
+	if (arg.Devs == 0)
+		arg.Dev[arg.Devs++] = INS_DEV_FILE;
+	if ((arg.Recipe == NULL) && (arg.sample_names != arg.Devs))
+	{
+		fprintf(stderr, "# E: %d <sample_name> for %d <dev>. See \"fet4p --help\"\n", arg.sample_names, arg.Devs);
+		ret = -1;
+		goto main_exit;
+	}
+	nrigs = arg.Devs;
+
+	// === a single run is a recipe of one entry
+	single   = arg;
+	entries  = &single;
+	nentries = 1;
+	if (arg.Recipe != NULL)
+	{
+		nentries = recipe_load(arg.Recipe, &single, &entries);
+		if (nentries < 0)
+		{
+			ret = -1;
+			goto main_exit;
+		}
+	}
+
 	#ifdef DEBUG
 	fprintf(stderr, "sample_name_flag = %d\n" , arg.sample_name_flag);
-	fprintf(stderr, "sample_name      = %s\n" , arg.sample_name);
+	for (k = 0; k < arg.sample_names; k++)
+		fprintf(stderr, "sample_name[%d]   = %s\n" , k, arg.sample_name[k]);
 	fprintf(stderr, "Chan             = %d\n" , arg.Chan);
 	fprintf(stderr, "V1_start         = %le\n", arg.V1_start);
 	fprintf(stderr, "V1_stop          = %le\n", arg.V1_stop);
@@ -295,52 +1086,183 @@ int main(int argc, char const *argv[])
 	fprintf(stderr, "I1_max           = %le\n", arg.I2_max);
 	fprintf(stderr, "Delay_flag       = %d\n" , arg.Delay_flag);
 	fprintf(stderr, "Delay            = %le\n", arg.Delay);
+	fprintf(stderr, "Separate         = %d\n" , arg.Separate);
+	fprintf(stderr, "Onboard          = %d\n" , arg.Onboard);
+	fprintf(stderr, "Pipeline         = %d\n" , arg.Pipeline);
+	fprintf(stderr, "Period           = %le\n", arg.Period);
+	fprintf(stderr, "Rt               = %d\n" , arg.Rt);
+	fprintf(stderr, "Rt_cpu           = %d\n" , arg.Rt_cpu);
+	fprintf(stderr, "Stress           = %le\n", arg.Stress);
+	fprintf(stderr, "Stress_interval  = %le\n", arg.Stress_interval);
+	fprintf(stderr, "Stress_sweep     = %le\n", arg.Stress_sweep);
+	fprintf(stderr, "Recipe           = %s\n" , arg.Recipe ? arg.Recipe : "none");
+	fprintf(stderr, "Resume           = %s\n" , arg.Resume ? arg.Resume : "none");
+	fprintf(stderr, "Telemetry        = %s\n" , arg.Telemetry ? arg.Telemetry : "none");
+	for (k = 0; k < arg.Devs; k++)
+		fprintf(stderr, "Dev[%d]           = %s\n" , k, arg.Dev[k]);
+	fprintf(stderr, "Sim_latency      = %le\n", arg.Sim_latency);
+	fprintf(stderr, "Sim_noise        = %le\n", arg.Sim_noise);
+	fprintf(stderr, "Timings          = %d\n" , arg.Timings);
+	fprintf(stderr, "Fps              = %le\n", arg.Fps);
+	fprintf(stderr, "Headless         = %d\n" , arg.Headless);
+	fprintf(stderr, "Format           = %d\n" , arg.Format);
+	fprintf(stderr, "Settle           = %d\n" , arg.Settle);
+	fprintf(stderr, "Settle_tol       = %le\n", arg.Settle_tol);
+	fprintf(stderr, "Sim_tau          = %le\n", arg.Sim_tau);
+	fprintf(stderr, "Refine           = %d\n" , arg.Refine);
+	fprintf(stderr, "Step_min         = %le\n", arg.Step_min);
+	fprintf(stderr, "Refine_tol       = %le\n", arg.Refine_tol);
+	fprintf(stderr, "Dry_run          = %d\n" , arg.Dry_run);
+	fprintf(stderr, "Ramp             = %le\n", arg.Ramp);
+	fprintf(stderr, "Ramp_read        = %d\n" , arg.Ramp_read);
+	fprintf(stderr, "Profile          = %s\n" , arg.Profile->name);
+	fprintf(stderr, "Samples          = %d\n" , arg.Samples);
+	fprintf(stderr, "Sem_tol          = %le\n", arg.Sem_tol);
+	fprintf(stderr, "Sem_abs          = %le\n", arg.Sem_abs);
+	fprintf(stderr, "Compliance       = %d\n" , arg.Compliance);
+	fprintf(stderr, "Fit_window       = %d\n" , arg.Fit_window);
+	fprintf(stderr, "Mu_k             = %le\n", arg.Mu_k);
+	fprintf(stderr, "Early_stop       = %le\n", arg.Early_stop);
+	fprintf(stderr, "Timeout          = %le\n", arg.Timeout);
+	fprintf(stderr, "Retries          = %d\n" , arg.Retries);
 	#endif
 
-	// === get start time of experiment ===
-	start_time = time(NULL);
-	localtime_r(&start_time, &start_time_struct);
+	// === compile the sweeps for validation, the ETA and the dry run
+	for (e = 0; e < nentries; e++)
+	{
+		arg = entries[e];
+		if (arg.Entry > 0)
+		{
+			fprintf(single.Dry_run ? stdout : stderr, "# Entry %s:%d:", arg.Recipe, arg.Entry);
+			for (k = 0; k < nrigs; k++)
+				fprintf(single.Dry_run ? stdout : stderr, " %s", arg.sample_name[k]);
+			fprintf(single.Dry_run ? stdout : stderr, "\n");
+		}
+
+		status = plan_summary(single.Dry_run ? stdout : stderr, single.Dry_run);
+		if (status < 0)
+		{
+			ret = -7;
+			goto main_exit;
+		}
+	}
+	if (single.Dry_run)
+		goto main_exit;
 
 	// === we need actual information w/o buffering
 	setlinebuf(stdout);
 	setlinebuf(stderr);
 
 	// === initialize run state variable
-	pthread_rwlock_init(&run_lock, NULL);
-	run = 1;
+	atomic_init(&run, 1);
 
-	// === initialize next state variable
-	pthread_rwlock_init(&next_lock, NULL);
-	next = 0;
+	// === Ctrl+C stops the run the same way as "q" command, a second one kills
+	sa.sa_handler = on_sigint;
+	sigemptyset(&sa.sa_mask);
+	sa.sa_flags = SA_RESTART | SA_RESETHAND;
+	sigaction(SIGINT, &sa, NULL);
 
-	// === create dirictory in "20191012_153504_<experiment_name>" format
-	snprintf(dir_str, 200, "%04d-%02d-%02d_%02d-%02d-%02d_%s",
-		start_time_struct.tm_year + 1900,
-		start_time_struct.tm_mon + 1,
-		start_time_struct.tm_mday,
-		start_time_struct.tm_hour,
-		start_time_struct.tm_min,
-		start_time_struct.tm_sec,
-		arg.sample_name
-	);
-	status = mkdir(dir_str, S_IRWXU | S_IRWXG | S_IROTH | S_IXOTH);
-	if (status == -1)
+	for (k = 0; k < nrigs; k++)
 	{
-		fprintf(stderr, "# E: unable to create experiment directory (%s)\n", strerror(errno));
-		ret = -2;
-		goto main_exit;
+		rigs[k].event_fd   = -1;
+		rigs[k].journal.fd = -1;
 	}
 
-	// === create file names
-	snprintf(filename_vac, 250, "%s/vac.dat", dir_str);
-	// printf("filename_vac \"%s\"\n", filename_vac);
+	for (k = 0; k < nrigs; k++)
+	{
+		rig = &rigs[k];
+		rig->id          = k;
+		rig->dev         = arg.Dev[k];
+		atomic_init(&rig->next, 0);
+		atomic_init(&rig->converged, 0);
+
+		rig->event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+		if (rig->event_fd == -1)
+		{
+			fprintf(stderr, "# E: unable to create eventfd (%s)\n", strerror(errno));
+			ret = -3;
+			goto main_rigs;
+		}
+	}
+
+	// === shared memory for external monitors, the object of the command
+	// line serves every entry
+	if (single.Telemetry != NULL)
+	{
+		status = telemetry_create(&telemetry, single.Telemetry, nrigs);
+		if (status < 0)
+		{
+			fprintf(stderr, "# E: Unable to create telemetry \"%s%s\" (%s)\n", TLM_PREFIX, single.Telemetry, strerror(-status));
+			ret = -8;
+			goto main_rigs;
+		}
+	}
+
+	arg = entries[0];
+	ret = entry_open(names);
+	if (ret < 0)
+		goto main_rigs;
+
+	// === open gnuplot, it shows all rigs and logs to the first directory
+	plot_range(&xcol, &xmin, &xmax);
+	status = plot_open(&plot, rigs[0].dir, arg.Headless ? 0.0 : arg.Fps, xcol, xmin, xmax, nrigs, names);
+	if (status < 0)
+	{
+		fprintf(stderr, "# E: unable to open gnuplot pipe (%s)\n", strerror(-status));
+		ret = -5;
+		goto main_rigs;
+	}
+
+	// === start output thread
+	status = sink_start(&sink, rigs, nrigs, &plot);
+	if (status < 0)
+	{
+		fprintf(stderr, "# E: Unable to start output thread\n");
+		ret = -6;
+		goto main_sink;
+	}
+
+	// === keep the pages of the acquisition resident, only touched pages of
+	// the thread stacks are locked
+	if (arg.Rt && (mlockall(MCL_CURRENT | MCL_FUTURE | MCL_ONFAULT) == -1))
+		fprintf(stderr, "# W: Unable to lock memory (%s)\n", strerror(errno));
 
 	// === now start threads
 	pthread_create(&t_commander, NULL, commander, NULL);
-	pthread_create(&t_worker, NULL, worker, NULL);
+	for (e = 0; ; )
+	{
+		for (k = 0; k < nrigs; k++)
+			pthread_create(&rigs[k].thread, NULL, worker, &rigs[k]);
+
+		// === and wait ...
+		for (k = 0; k < nrigs; k++)
+			pthread_join(rigs[k].thread, NULL);
+
+		if (atomic_load(&sink.error) || !get_run() || (++e == nentries))
+			break;
+
+		// === the next entry gets new files, the instruments, the plot and
+		// the output thread stay
+		sink_pause(&sink);
+		for (k = 0; k < nrigs; k++)
+			rig_close(&rigs[k]);
 
-	// === and wait ...
-	pthread_join(t_worker, NULL);
+		arg = entries[e];
+		ret = entry_open(names);
+		if (ret < 0)
+		{
+			sink_resume(&sink);
+			break;
+		}
+		plot_range(&xcol, &xmin, &xmax);
+		status = plot_reset(&plot, xcol, xmin, xmax, names);
+		if (status < 0)
+			fprintf(stderr, "# E: Unable to print to gp (%s)\n", strerror(-status));
+		sink_resume(&sink);
+	}
+
+	for (k = 0; k < nrigs; k++)
+		rig_shutdown(&rigs[k]);
 
 	// === cancel commander thread becouse we don't need it anymore
 	// === and wait for cancelation finish
@@ -349,9 +1271,28 @@ int main(int argc, char const *argv[])
 
 	fprintf(stdout, "\r\n");
 
-	main_exit:
-	return ret;
-}
+	sink_stop(&sink);
+	main_sink:
+
+	plot_close(&plot);
+	main_rigs:
+
+	// rigs past the failed one are not opened
+	for (k = 0; k < nrigs; k++)
+	{
+		rig_close(&rigs[k]);
+		if (rigs[k].event_fd != -1)
+			close(rigs[k].event_fd);
+	}
+	telemetry_close(&telemetry);
+
+	main_exit:
+	if ((entries != NULL) && (entries != &single))
+		free(entries);
+	free(words);
+	journal_free(&resume);
+	return ret;
+}
 
 // === commander function
 static void *commander(void *a)
@@ -361,6 +1302,7 @@ static void *commander(void *a)
 	char str[100];
 	char *s;
 	int ccount;
+	int k;
 
 	while(get_run())
 	{
@@ -380,11 +1322,22 @@ static void *commander(void *a)
 				printf(
 					"Help:\n"
 					"\th -- this help;\n"
-					"\tn -- next stage;\n"
-					"\tq -- exit the program;\n");
+					"\tn -- next stage of all rigs;\n"
+					"\tn <rig> -- next stage of one rig (1 - %d);\n"
+					"\tq -- exit the program;\n", nrigs);
 				break;
 			case 'n':
-				set_next(1);
+				k = atoi(str + 1);
+				if ((k < 0) || (k > nrigs))
+				{
+					fprintf(stderr, "# E: Unknown rig (%d)\n", k);
+					break;
+				}
+				if (k > 0)
+					set_next(&rigs[k - 1], 1);
+				else
+					for (k = 0; k < nrigs; k++)
+						set_next(&rigs[k], 1);
 				break;
 			case 'q':
 				set_run(0);
@@ -402,456 +1355,2588 @@ static void *commander(void *a)
 // === worker function
 static void *worker(void *a)
 {
-	(void) a;
+	struct rig *rig = a;
 
 	int r;
 
-	FILE *dev_fd;
+	struct instrument *ins = &rig->ins;
+	struct sim_config sim;
 
 	int    vac_index;
 	double vac_time;
-	double V1, I1, V2, I2;
+	struct point pt;
+	double settle;
+	double next;
 
 	double t;
 
-	double voltage;
-	int dir;
-
-	FILE  *vac_fp;
-	FILE  *gp;
-	char   buf[300];
-	char  *c;
+	double voltage = 0.0;
 
-	enum meas_state state = M_BEFORE;
-	int i1, i2, i3;
+	enum meas_state state;
+	struct plan plan = {0};
+	int k, k_point;
 
 	double V_start, V_stop, V_step;
 
+	// plan points are <unit> apart, each point advances by <inc> of them
+	double unit;
+	int    inc, inc_max;
+	enum meas_state refine_stage = M_BEFORE;
+	double refine_I = 0.0;
+
+	// stage 2 was retraced after compliance
+	int reversed = 0;
+
+	// level set with the readback of the previous point, and when
+	double preset = NAN;
+	uint64_t t_preset = 0;
+
+	// slot of the last paced point, 0 - the grid starts with the next one
+	uint64_t pace = 0;
+
+	uint64_t t_ph, t_pt;
+
 	V_start = (arg.Chan == 1) ? arg.V1_start : arg.V2_start;
 	V_stop  = (arg.Chan == 1) ? arg.V1_stop  : arg.V2_stop;
 	V_step  = (arg.Chan == 1) ? arg.V1_step  : arg.V2_step;
 
-	dev_fd = fopen(INS_DEV_FILE, "r+");
-	if(dev_fd == NULL)
+	unit = refine_unit(V_step, &inc_max);
+	inc  = inc_max;
+
+	if (arg.Rt)
+		rt_enter(rig);
+
+	// === compile the sweep, the first stage is skipped if V_start is near 0,
+	// a resumed run compiles the last plan of its journal
+	state = (fabs(V_start) < V_step) ? M_STAGE2 : M_STAGE1;
+	if ((arg.Resume != NULL) && (resume.plans > 0))
+	{
+		state    = resume.plan.stage;
+		V_start  = resume.plan.V_start;
+		V_stop   = resume.plan.V_stop;
+		reversed = resume.plan.reversed;
+	}
+	r = plan_build(&plan, state, V_start, V_stop, unit);
+	if (r < 0)
+	{
+		fprintf(stderr, "# E: Unable to compile sweep plan (%s)\n", strerror(-r));
+		goto worker_plan;
+	}
+
+	k = 0;
+	rig->last_index = -1;
+	if (arg.Resume != NULL)
+	{
+		k = resume_point(&plan);
+		rig->last_index = resume.point.index;
+	}
+	else
+		rig_plan(rig, state, V_start, V_stop, reversed);
+
+	// the instrument stays open for the following recipe entries
+	if (!rig->ins_open)
 	{
-		fprintf(stderr, "# E: Unable to open power supply \"%s\" (%s)\n", INS_DEV_FILE, strerror(ferror(dev_fd)));
-		goto worker_dev_open;
+		sim.latency = arg.Sim_latency;
+		sim.noise   = arg.Sim_noise;
+		sim.tau     = arg.Sim_tau;
+
+		r = ins_open(ins, rig->dev, &sim);
+		if(r < 0)
+		{
+			fprintf(stderr, "# E: Unable to open power supply \"%s\" (%s)\n", rig->dev, strerror(-r));
+			goto worker_dev_open;
+		}
+		rig->ins_open = 1;
 	}
-	setlinebuf(dev_fd);
+	ins->timeout = arg.Timeout;
+	ins->retries = arg.Retries;
+
+	// === the init block is sent again only when its settings change
+	if (rig->setup.valid && (rig->setup.I1_max == arg.I1_max) && (rig->setup.I2_max == arg.I2_max) &&
+		(rig->setup.profile == arg.Profile))
+		goto worker_init;
 
 	// === init device
 	// channel A - V1
-	fprintf(dev_fd, "smua.source.output = smua.OUTPUT_OFF\n");
-	fprintf(dev_fd, "smua.source.func = smua.OUTPUT_DCVOLTS\n");
-	fprintf(dev_fd, "smua.source.autorangev = smua.AUTORANGE_ON\n");
-	fprintf(dev_fd, "smua.source.levelv = 0.0\n");
-	fprintf(dev_fd, "smua.source.limiti = %le\n", arg.I1_max);
+	ins_printf(ins, "smua.source.output = smua.OUTPUT_OFF\n");
+	ins_printf(ins, "smua.source.func = smua.OUTPUT_DCVOLTS\n");
+	ins_printf(ins, "smua.source.autorangev = smua.AUTORANGE_ON\n");
+	ins_printf(ins, "smua.source.levelv = 0.0\n");
+	ins_printf(ins, "smua.source.limiti = %le\n", arg.I1_max);
 
 	// channel B - V2
-	fprintf(dev_fd, "smub.source.output = smub.OUTPUT_OFF\n");
-	fprintf(dev_fd, "smub.source.func = smub.OUTPUT_DCVOLTS\n");
-	fprintf(dev_fd, "smub.source.autorangev = smub.AUTORANGE_ON\n");
-	fprintf(dev_fd, "smub.source.levelv = 0.0\n");
-	fprintf(dev_fd, "smub.source.limiti = %le\n", arg.I2_max);
-
-	// === create vac file
-	vac_fp = fopen(filename_vac, "w+");
-	if(vac_fp == NULL)
+	ins_printf(ins, "smub.source.output = smub.OUTPUT_OFF\n");
+	ins_printf(ins, "smub.source.func = smub.OUTPUT_DCVOLTS\n");
+	ins_printf(ins, "smub.source.autorangev = smub.AUTORANGE_ON\n");
+	ins_printf(ins, "smub.source.levelv = 0.0\n");
+	ins_printf(ins, "smub.source.limiti = %le\n", arg.I2_max);
+
+	// measurement profile
+	if (arg.Profile != &profiles[0])
 	{
-		fprintf(stderr, "# E: Unable to open file \"%s\" (%s)\n", filename_vac, strerror(ferror(vac_fp)));
-		goto worker_vac_fopen;
+		profile_apply(ins, "smua");
+		profile_apply(ins, "smub");
 	}
-	setlinebuf(vac_fp);
 
-	fprintf(stderr, "1\n");
+	ins_printf(ins, "smua.source.output = smua.OUTPUT_ON\n");
+	ins_printf(ins, "smub.source.output = smub.OUTPUT_ON\n");
 
-	// === write vac header
-	r = fprintf(vac_fp,
-		"# Measuring of charge carrier mobility of thin films"
-			"in field effect transistor structure by the four probe method\n"
-		"# Id vs Vg\n"
-		"# Date: %04d.%02d.%02d %02d:%02d:%02d\n"
-		"# Start parameters:\n"
-		"#   sample_name      = %s\n"
-		"#   Chan             = %d\n"
-		"#   V1_start         = %le\n"
-		"#   V1_stop          = %le\n"
-		"#   V1_step          = %le\n"
-		"#   I1_max           = %le\n"
-		"#   V2_start         = %le\n"
-		"#   V2_stop          = %le\n"
-		"#   V2_step          = %le\n"
-		"#   I2_max           = %le\n"
-		"#   Delay            = %le\n"
-		"# 1: index\n"
-		"# 2: time, s\n"
-		"# 3: V1, V\n"
-		"# 4: I1, A\n"
-		"# 5: V2, V\n"
-		"# 6: I2, A\n",
-		start_time_struct.tm_year + 1900,
-		start_time_struct.tm_mon + 1,
-		start_time_struct.tm_mday,
-		start_time_struct.tm_hour,
-		start_time_struct.tm_min,
-		start_time_struct.tm_sec,
-		arg.sample_name,
-		arg.Chan,
-		arg.V1_start,
-		arg.V1_stop,
-		arg.V1_step,
-		arg.I1_max,
-		arg.V2_start,
-		arg.V2_stop,
-		arg.V2_step,
-		arg.I2_max,
-		arg.Delay
-	);
-	if(r < 0)
-	{
-		fprintf(stderr, "# E: Unable to print to file \"%s\" (%s)\n", filename_vac, strerror(r));
-		goto worker_vac_header;
-	}
-
-	// === open gnuplot
-	snprintf(buf, 300, "gnuplot > %s/gnuplot.log 2>&1", dir_str);
-	gp = popen(buf, "w");
-	if (gp == NULL)
-	{
-		fprintf(stderr, "# E: unable to open gnuplot pipe (%s)\n", strerror(errno));
-		goto worker_gp_popen;
-	}
-	setlinebuf(gp);
-
-	// === prepare gnuplot
-	r = fprintf(gp,
-		"set term qt noraise\n"
-		"set xzeroaxis lt -1\n"
-		"set yzeroaxis lt -1\n"
-		"set grid\n"
-		"set key right bottom\n"
-		"set xrange [%le:%le]\n"
-		"set xlabel \"Vg, V\"\n"
-		"set ylabel \"Id, A\"\n"
-		"set format y \"%%.3s%%c\"\n",
-		V_start,
-		V_stop
-	);
-	if(r < 0)
-	{
-		fprintf(stderr, "# E: Unable to print to gp (%s)\n", strerror(r));
-		goto worker_gp_settings;
-	}
+	rig->setup.valid   = 1;
+	rig->setup.I1_max  = arg.I1_max;
+	rig->setup.I2_max  = arg.I2_max;
+	rig->setup.profile = arg.Profile;
+	worker_init:
 
 	// === let the action begins!
 	vac_index = 0;
 
-	fprintf(dev_fd, "smua.source.output = smua.OUTPUT_ON\n");
-	fprintf(dev_fd, "smub.source.output = smub.OUTPUT_ON\n");
-
 	if (arg.Chan == 1)
-		fprintf(dev_fd, "smub.source.levelv = %lf\n", arg.V2_start);
-	else
-		fprintf(dev_fd, "smua.source.levelv = %lf\n", arg.V1_start);
-
-	if (fabs(V_start) < V_step)
-		state = M_STAGE2;
+		ins_printf(ins, "smub.source.levelv = %lf\n", arg.V2_start);
 	else
-		state = M_STAGE1;
+		ins_printf(ins, "smua.source.levelv = %lf\n", arg.V1_start);
 
-	i1 = i2 = i3 = 0;
+	// === a resumed run goes on after the last committed point, the
+	// scanning channel is brought back to its setpoint from 0 V first
+	if (arg.Resume != NULL)
+	{
+		vac_index = resume.point.index + 1;
+		if (k >= plan.n)
+			fprintf(stderr, "# %s: the journal ends with the last point of the sweep\n", rig->sample_name);
+		else
+		{
+			state   = plan.pt[k].stage;
+			voltage = plan.pt[k].voltage;
+			if (resume_ramp(rig, ins, voltage, V_step))
+				k = plan.n;
+		}
+	}
 
+	// the host loop below only runs out of points
+	if (arg.Stress > 0)
+	{
+		stress_run(rig, ins, V_start, V_stop, V_step, &vac_index);
+		k = plan.n;
+	}
+	else if (arg.Onboard)
+	{
+		if (k < plan.n)
+			sweep_onboard(rig, ins, &plan, k, reversed, V_start, V_stop, V_step, &vac_index);
+		k = plan.n;
+	}
 
-// set_run(0);
 	while(get_run())
 	{
-		switch(state)
+		// "next stage" ends the stage of the last point, the rest of the
+		// sweep is compiled again from the voltage reached
+		if (get_next(rig) || take_converged(rig, state))
 		{
-			case M_STAGE1:
-				dir = direction(0.0, V_start);
-				if (get_next())
-				{
-					V_start = voltage + V_step * dir;
-					state = M_STAGE2;
-					set_next(0);
-				}
-				else
-				{
-					voltage = 0.0 + i1 * V_step * dir;
-					if (((dir > 0) && (voltage >= V_start)) || ((dir < 0) && (voltage <= V_start)))
-						state = M_STAGE2;
-					else
-					{
-						i1++;
-						vac_index++;
-						break;
-					}
-				}
-			case M_STAGE2:
-				dir = direction(V_start, V_stop);
-				if (get_next())
-				{
-					V_stop = voltage + V_step * dir;
-					state = M_STAGE3;
-					set_next(0);
-				}
-				else
-				{
-					voltage = V_start + i2 * V_step * dir;
-					if (((dir > 0) && (voltage >= V_stop)) || ((dir < 0) && (voltage <= V_stop)))
-						state = M_STAGE3;
-					else
-					{
-						i2++;
-						vac_index++;
-						break;
-					}
-				}
-			case M_STAGE3:
-				if (get_next())
-				{
-					state = M_AFTER;
-					set_next(0);
-					break;
-				}
-				else
-				{
-					dir = direction(V_stop, 0.0);
-					voltage = V_stop + i3 * V_step * dir;
-					if (((dir > 0) && (voltage >= 0.0)) || ((dir < 0) && (voltage <= 0.0)))
-						state = M_AFTER;
-					else
-					{
-						i3++;
-						vac_index++;
-						break;
-					}
-				}
-			default:
-				state = M_STOP;
+			set_next(rig, 0);
+			if (state >= M_STAGE3)
+				break;
+
+			if (plan_next(rig, &plan, state, voltage, &V_start, &V_stop, V_step) < 0)
+				break;
+			state++;
+			k = 0;
+			continue;
 		}
 
-		if (state > M_STAGE3)
-		{
-			set_run(0);
+		if (k >= plan.n)
 			break;
+
+		// approach and return stages are ramped as a whole
+		state = plan.pt[k].stage;
+		if ((arg.Ramp > 0) && (state != M_STAGE2))
+		{
+			r = ramp_segment(rig, ins, state, &plan.pt[k], plan.first[state + 1] - k, &vac_index, &voltage);
+			if (r < 0)
+				break;
+			k = plan.first[state + 1];
+			pace = 0;
+
+			if ((r == 1) && (state < M_STAGE3))
+			{
+				if (plan_next(rig, &plan, state, voltage, &V_start, &V_stop, V_step) < 0)
+					break;
+				state++;
+				k = 0;
+			}
+			continue;
 		}
 
-		fprintf(stderr, "voltage = %lf\n", voltage);
+		if ((arg.Period > 0) && (pace_point(rig, &pace) != 0))
+			continue;
 
-		if (arg.Chan == 1)
-			fprintf(dev_fd, "smua.source.levelv = %lf\n", voltage);
-		else
-			fprintf(dev_fd, "smub.source.levelv = %lf\n", voltage);
+		voltage = plan.pt[k].voltage;
+		k_point = k;
+		k = plan_advance(&plan, k_point, inc);
 
-		usleep(arg.Delay * 1e6);
+		fprintf(stderr, "voltage = %lf\n", voltage);
+		telemetry_setpoint(&telemetry, rig->id, state, voltage);
 
-		vac_time = get_time();
-		if (vac_time < 0)
-		{
-			fprintf(stderr, "# E: Unable to get time\n");
-			set_run(0);
-			break;
-		}
+		t_pt = t_ph = lat_now();
 
-		fprintf(dev_fd, "print(smua.measure.v())\n");
-		c = fgets(buf, 300, dev_fd);
-		if (c == NULL)
+		// a stage change, refinement or compliance may have moved the point
+		if (voltage != preset)
 		{
-			fprintf(stderr, "# E: Unable to read from device (%s)\n", strerror(ferror(dev_fd)));
-			set_run(0);
-			break;
+			if (arg.Chan == 1)
+				ins_printf(ins, "smua.source.levelv = %lf\n", voltage);
+			else
+				ins_printf(ins, "smub.source.levelv = %lf\n", voltage);
+			t_preset = lat_now();
 		}
-		sscanf(buf, "%lf", &V1);
+		preset = NAN;
+		phase_mark(rig, PH_LEVEL, &t_ph);
 
-		fprintf(dev_fd, "print(smua.measure.i())\n");
-		c = fgets(buf, 300, dev_fd);
-		if (c == NULL)
-		{
-			fprintf(stderr, "# E: Unable to read from device (%s)\n", strerror(ferror(dev_fd)));
-			set_run(0);
+		r = settle_point(rig, ins, t_preset, &settle);
+		phase_mark(rig, PH_SETTLE, &t_ph);
+		if (r < 0)
 			break;
-		}
-		sscanf(buf, "%lf", &I1);
+		if (r)
+			continue;
 
-		fprintf(dev_fd, "print(smub.measure.v())\n");
-		c = fgets(buf, 300, dev_fd);
-		if (c == NULL)
+		vac_time = get_time(rig);
+		if (vac_time < 0)
 		{
-			fprintf(stderr, "# E: Unable to read from device (%s)\n", strerror(ferror(dev_fd)));
-			set_run(0);
+			fprintf(stderr, "# E: Unable to get time\n");
 			break;
 		}
-		sscanf(buf, "%lf", &V2);
 
-		fprintf(dev_fd, "print(smub.measure.i())\n");
-		c = fgets(buf, 300, dev_fd);
-		if (c == NULL)
-		{
-			fprintf(stderr, "# E: Unable to read from device (%s)\n", strerror(ferror(dev_fd)));
-			set_run(0);
-			break;
-		}
-		sscanf(buf, "%lf", &I2);
+		// the next point of a measured stage is set as soon as this one is
+		// read, the host work below overlaps its settling
+		next = NAN;
+		if (pipelined() && (k < plan.n) && ((arg.Ramp <= 0) || (plan.pt[k].stage == M_STAGE2)))
+			next = plan.pt[k].voltage;
 
-		r = fprintf(vac_fp, "%d\t%le\t%+le\t%+le\t%+le\t%+le\n",
-			vac_index,
-			vac_time,
-			V1, I1, V2, I2
-		);
-		if(r < 0)
-		{
-			fprintf(stderr, "# E: Unable to print to file \"%s\" (%s)\n", filename_vac, strerror(r));
-			set_run(0);
+		r = sample_point(rig, ins, arg.Samples, next, &pt);
+		if (r < 0)
 			break;
-		}
-
-		r = fprintf(gp, "set title \"i = %d, t = %.3lf s\"\n", vac_index, vac_time);
-		r = fprintf(gp,
-			"plot \"%s\" u %d:4 w l lw 1 title \"V1 = %.3lf V, I1 = %le A\", "
-			       "\"\" u %d:6 w l lw 1 title \"V2 = %.3lf V, I2 = %le A\"\n",
-			filename_vac,
-			(arg.Chan == 1) ? 3 : 5, V1, I1,
-			(arg.Chan == 1) ? 3 : 5, V2, I2
-		);
-		if(r < 0)
+		if (r == 1)
 		{
-			fprintf(stderr, "# E: Unable to print to gp (%s)\n", strerror(r));
-			set_run(0);
-			break;
+			preset   = next;
+			t_preset = lat_now();
 		}
+		phase_mark(rig, PH_READ, &t_ph);
+
+		pt.index  = vac_index;
+		pt.stage  = state;
+		pt.time   = vac_time;
+		pt.settle = settle;
+		comply_point(&pt);
+		r = output_point(rig, &pt);
+		if (r < 0)
+			break;
 
-		vac_index++;
-	}
-
-	fprintf(dev_fd, "smua.source.levelv = 0.0\n");
-	fprintf(dev_fd, "smub.source.levelv = 0.0\n");
-	usleep(1e6);
-	fprintf(dev_fd, "smua.source.output = smua.OUTPUT_OFF\n");
-	fprintf(dev_fd, "smub.source.output = smua.OUTPUT_OFF\n");
-
-	fprintf(dev_fd, "beeper.beep(0.15, 220.0)");
-	fprintf(dev_fd, "beeper.beep(0.15, 130.8)");
-	fprintf(dev_fd, "beeper.beep(0.30, 146.8)");
-	fprintf(dev_fd, "beeper.beep(0.30, 146.8)");
-	fprintf(dev_fd, "beeper.beep(0.15, 146.8)");
-	fprintf(dev_fd, "beeper.beep(0.15, 164.8)");
-	fprintf(dev_fd, "beeper.beep(0.30, 174.6)");
-	fprintf(dev_fd, "beeper.beep(0.30, 174.6)");
-	fprintf(dev_fd, "beeper.beep(0.15, 174.6)");
-	fprintf(dev_fd, "beeper.beep(0.15, 196.0)");
-	fprintf(dev_fd, "beeper.beep(0.30, 164.8)");
-	fprintf(dev_fd, "beeper.beep(0.30, 164.8)");
-	fprintf(dev_fd, "beeper.beep(0.15, 146.8)");
-	fprintf(dev_fd, "beeper.beep(0.15, 130.8)");
-	fprintf(dev_fd, "beeper.beep(0.15, 130.8)");
-	fprintf(dev_fd, "beeper.beep(0.30, 146.8)");
-
-	r = fprintf(gp, "exit;\n");
-	if(r < 0)
-	{
-		fprintf(stderr, "# E: Unable to print to gp (%s)\n", strerror(r));
-	}
+		// stage 2 is retraced from the limit back to V_start once,
+		// otherwise the stage ends and the next one starts a step back
+		if (pt.compliance && (arg.Compliance != COMPLY_OFF))
+		{
+			fprintf(stderr, "# W: Compliance at %lf V in stage %d\n", voltage, state);
 
-	worker_gp_settings:
+			r = 1;
+			if ((arg.Compliance == COMPLY_REVERSE) && (state == M_STAGE2) && !reversed)
+			{
+				r = plan_reverse(rig, &plan, voltage, &V_start, &V_stop, V_step);
+				reversed = (r == 0);
+			}
+			if ((r == 1) && (state < M_STAGE3))
+			{
+				r = plan_next(rig, &plan, state, voltage, &V_start, &V_stop, -V_step);
+				state++;
+			}
+			if (r < 0)
+				break;
 
-	r = pclose(gp);
-	if (r == -1)
-	{
-		fprintf(stderr, "# E: Unable to close gnuplot pipe (%s)\n", strerror(errno));
-	}
-	worker_gp_popen:
+			// the end of stage 3 ends the sweep
+			k = (r == 1) ? plan.n : 0;
+			refine_stage = M_BEFORE;
+		}
 
+		// the next point was taken with the old step, take it again
+		if ((inc_max > 1) && (refine_stage == state))
+		{
+			inc = refine_step(refine_I, pt.I2, inc, inc_max);
+			k = plan_advance(&plan, k_point, inc);
+		}
+		refine_stage = state;
+		refine_I     = pt.I2;
 
-	worker_vac_header:
+		phase_mark(rig, PH_POINT, &t_pt);
+		timing_point(rig, vac_index);
 
-	r = fclose(vac_fp);
-	if (r == EOF)
-	{
-		fprintf(stderr, "# E: Unable to close file \"%s\" (%s)\n", filename_vac, strerror(errno));
+		vac_index++;
 	}
-	worker_vac_fopen:
 
-	fclose(dev_fd);
+	// the outputs are turned off by rig_shutdown() after the last entry
+	ins_printf(ins, "smua.source.levelv = 0.0\n");
+	ins_printf(ins, "smub.source.levelv = 0.0\n");
+
+	if (rig->phase_hist[PH_LAG].count > 0)
+		fprintf(stderr, "# Pace: %s: %" PRIu64 " points, lag p50 %.3lf ms, p99 %.3lf ms, max %.3lf ms, %" PRIu64 " missed slots\n",
+			rig->dev,
+			rig->phase_hist[PH_LAG].count,
+			lat_percentile(&rig->phase_hist[PH_LAG], 0.50) / 1e6,
+			lat_percentile(&rig->phase_hist[PH_LAG], 0.99) / 1e6,
+			rig->phase_hist[PH_LAG].max / 1e6,
+			rig->overruns);
 	worker_dev_open:
 
+	plan_free(&plan);
+	worker_plan:
+
+	telemetry_idle(&telemetry, rig->id);
 	return NULL;
 }
 
-// === utils
-static int get_run()
+// ramp down, turn the outputs off and close the instrument of a rig after
+// the last entry, the worker has left the levels at 0 V
+static void rig_shutdown(struct rig *rig)
 {
-	int run_local;
-	pthread_rwlock_rdlock(&run_lock);
-		run_local = run;
-	pthread_rwlock_unlock(&run_lock);
-	return run_local;
-}
+	struct instrument *ins = &rig->ins;
 
-static void set_run(int run_new)
-{
-	pthread_rwlock_wrlock(&run_lock);
-		run = run_new;
-	pthread_rwlock_unlock(&run_lock);
+	if (!rig->ins_open)
+		return;
+
+	usleep(1e6);
+	ins_printf(ins, "smua.source.output = smua.OUTPUT_OFF\n");
+	ins_printf(ins, "smub.source.output = smua.OUTPUT_OFF\n");
+
+	ins_printf(ins, "beeper.beep(0.15, 220.0)\n");
+	ins_printf(ins, "beeper.beep(0.15, 130.8)\n");
+	ins_printf(ins, "beeper.beep(0.30, 146.8)\n");
+	ins_printf(ins, "beeper.beep(0.30, 146.8)\n");
+	ins_printf(ins, "beeper.beep(0.15, 146.8)\n");
+	ins_printf(ins, "beeper.beep(0.15, 164.8)\n");
+	ins_printf(ins, "beeper.beep(0.30, 174.6)\n");
+	ins_printf(ins, "beeper.beep(0.30, 174.6)\n");
+	ins_printf(ins, "beeper.beep(0.15, 174.6)\n");
+	ins_printf(ins, "beeper.beep(0.15, 196.0)\n");
+	ins_printf(ins, "beeper.beep(0.30, 164.8)\n");
+	ins_printf(ins, "beeper.beep(0.30, 164.8)\n");
+	ins_printf(ins, "beeper.beep(0.15, 146.8)\n");
+	ins_printf(ins, "beeper.beep(0.15, 130.8)\n");
+	ins_printf(ins, "beeper.beep(0.15, 130.8)\n");
+	ins_printf(ins, "beeper.beep(0.30, 146.8)\n");
+
+	if (ins->timeouts || ins->repeats || ins->reconnects)
+		fprintf(stderr, "# W: %s: %lu timeouts, %lu repeated queries, %lu reconnects\n",
+			rig->dev, ins->timeouts, ins->repeats, ins->reconnects);
+
+	ins_close(ins);
+	rig->ins_open    = 0;
+	rig->setup.valid = 0;
 }
 
-static int get_next()
+// configure integration, ranging, autozero, filter and delay of one channel
+static void profile_apply(struct instrument *ins, const char *smu)
 {
-	int next_local;
-	pthread_rwlock_rdlock(&next_lock);
-		next_local = next;
-	pthread_rwlock_unlock(&next_lock);
-	return next_local;
+	const struct profile *p = arg.Profile;
+
+	ins_printf(ins, "%s.measure.nplc = %le\n", smu, p->nplc);
+	ins_printf(ins, "%s.measure.autorangei = %s.AUTORANGE_ON\n", smu, smu);
+	ins_printf(ins, "%s.measure.autorangev = %s.AUTORANGE_ON\n", smu, smu);
+	ins_printf(ins, "%s.measure.autozero = %s.%s\n", smu, smu, p->autozero);
+	if (p->filter > 0)
+		ins_printf(ins,
+			"%s.measure.filter.type = %s.FILTER_REPEAT_AVG "
+			"%s.measure.filter.count = %d "
+			"%s.measure.filter.enable = %s.FILTER_ON\n",
+			smu, smu, smu, p->filter, smu, smu);
+	else
+		ins_printf(ins, "%s.measure.filter.enable = %s.FILTER_OFF\n", smu, smu);
+	ins_printf(ins, "%s.measure.delay = %s.%s\n", smu, smu, p->delay);
 }
 
-static void set_next(int next_new)
+// duration of one reading with the selected profile, s
+static double profile_read_time(void)
 {
-	pthread_rwlock_wrlock(&next_lock);
-		next = next_new;
-	pthread_rwlock_unlock(&next_lock);
+	const struct profile *p = arg.Profile;
+
+	return p->nplc * ((p->filter > 0) ? p->filter : 1) / PROFILE_LINE;
 }
 
-static double get_time()
+// compile the sweep of the arguments, check it and print the point count
+// and the expected duration, the plan itself with <points>
+// the duration is an upper bound with --settle, --refine gives a range
+static int plan_summary(FILE *fp, int points)
 {
-	static int first = 1;
-	static struct timeval t_first = {0};
-	struct timeval t = {0};
-	double ret;
-	int r;
+	struct plan plan = {0};
+	double V_start, V_stop, V_step;
+	double unit, t_read, t_ramp, eta_min, eta_max;
+	int    inc_max, n_min, n_max, count, stage, s, r;
+
+	V_start = (arg.Chan == 1) ? arg.V1_start : arg.V2_start;
+	V_stop  = (arg.Chan == 1) ? arg.V1_stop  : arg.V2_stop;
+	V_step  = (arg.Chan == 1) ? arg.V1_step  : arg.V2_step;
 
-	if (first == 1)
+	unit  = refine_unit(V_step, &inc_max);
+	stage = (fabs(V_start) < V_step) ? M_STAGE2 : M_STAGE1;
+	r = plan_build(&plan, stage, V_start, V_stop, unit);
+	if (r < 0)
 	{
-		r = gettimeofday(&t_first, NULL);
-		if (r == -1)
-		{
-			fprintf(stderr, "# E: unable to get time (%s)\n", strerror(errno));
-			ret = -1;
-		}
-		else
-		{
-			ret = 0.0;
-			first = 0;
-		}
+		fprintf(stderr, "# E: Unable to compile sweep plan (%s)\n", strerror(-r));
+		return -1;
 	}
-	else
+
+	if (plan_vmax(&plan) > V_LIMIT + 1e-9)
 	{
-		r = gettimeofday(&t, NULL);
-		if (r == -1)
-		{
-			fprintf(stderr, "# E: unable to get time (%s)\n", strerror(errno));
-			ret = -2;
-		}
-		else
+		fprintf(stderr, "# E: Sweep plan leaves the +-%.1lf V range\n", V_LIMIT);
+		plan_free(&plan);
+		return -2;
+	}
+
+	// the coarsest adaptive sweep takes every inc_max-th point of each
+	// measured stage, ramped stages cost their span at the slew rate
+	t_read  = (arg.Separate ? 4 : 2) * profile_read_time();
+	t_ramp  = 0.0;
+	n_min   = 0;
+	n_max   = 0;
+	for (s = M_STAGE1; s <= M_STAGE3; s++)
+	{
+		count = plan.first[s + 1] - plan.first[s];
+		if ((arg.Ramp > 0) && (s != M_STAGE2))
 		{
-			ret = (t.tv_sec - t_first.tv_sec) * 1e6 + (t.tv_usec - t_first.tv_usec);
-			ret /= 1e6;
+			t_ramp += count * unit / arg.Ramp;
+			if (arg.Ramp_read > 0)
+				t_ramp += (count / arg.Ramp_read) * t_read;
+			continue;
 		}
+		n_min += (count + inc_max - 1) / inc_max;
+		n_max += count;
 	}
 
-	return ret;
+	// sequential sampling takes SAMPLE_MIN to --samples readings per point,
+	// a paced point takes a whole period unless it overruns it
+	eta_min = n_min * fmax(arg.Period, arg.Delay + ((arg.Samples > 1) ? SAMPLE_MIN : 1) * t_read) + t_ramp + ETA_RAMP;
+	eta_max = n_max * fmax(arg.Period, arg.Delay + arg.Samples * t_read) + t_ramp + ETA_RAMP;
+
+	if ((arg.Period > 0) && !arg.Onboard && (arg.Period < arg.Delay + t_read))
+		fprintf(stderr, "# W: --period is shorter than --delay and one readback, points will miss their slots\n");
+
+	if (points)
+	{
+		fprintf(fp, "# Sweep plan\n");
+		fprintf(fp, "# 1: index\n");
+		fprintf(fp, "# 2: stage\n");
+		fprintf(fp, "# 3: voltage, V\n");
+		plan_print(fp, &plan);
+	}
+
+	fprintf(fp, "# Plan: %d points (stage 1: %d, stage 2: %d, stage 3: %d), step %le V",
+		plan.n,
+		plan.first[M_STAGE2] - plan.first[M_STAGE1],
+		plan.first[M_STAGE3] - plan.first[M_STAGE2],
+		plan.first[M_STAGE3 + 1] - plan.first[M_STAGE3],
+		unit);
+	if (inc_max > 1)
+		fprintf(fp, ", at least %d with adaptive step", n_min);
+	fprintf(fp, "\n");
+	if (arg.Ramp > 0)
+		fprintf(fp, "# Ramp: stages 1 and 3 at %lf V/s, %d points measured\n", arg.Ramp, n_max);
+	fprintf(fp, "# Limits: |V| <= %lf V, I1_max = %le A, I2_max = %le A\n",
+		plan_vmax(&plan), arg.I1_max, arg.I2_max);
+	// a stress reading is one measure.iv, the interruption sweeps are
+	// stage 2 on the instrument
+	if (arg.Stress > 0)
+	{
+		count = (arg.Stress_sweep > 0) ? (int) ceil(arg.Stress / arg.Stress_sweep) - 1 : 0;
+		fprintf(fp, "# Stress: V1 = %lf V, V2 = %lf V for %.0lf s, up to %.0lf readings/s, %d interruption sweeps\n",
+			arg.V1_start, arg.V2_start, arg.Stress, 1.0 / (arg.Stress_interval + 2 * profile_read_time()), count);
+		fprintf(fp, "# ETA: %.0lf s\n", arg.Stress + count * (plan.first[M_STAGE3] - plan.first[M_STAGE2]) *
+			(arg.Delay + 2 * profile_read_time()) + ETA_RAMP);
+	}
+	else if ((inc_max > 1) || (arg.Samples > 1))
+		fprintf(fp, "# ETA: %.0lf - %.0lf s\n", eta_min, eta_max);
+	else
+		fprintf(fp, "# ETA: %s%.0lf s\n", arg.Settle ? "<= " : "", eta_max);
+
+	plan_free(&plan);
+	return 0;
 }
 
-static int direction(double start, double stop)
+// build the vac header and create the output and timing files of a rig
+static int rig_open(struct rig *rig)
 {
-	return (stop >= start) ? 1 : -1;
+	FILE  *hdr_fp;
+	struct vacbin_header bin_hdr;
+	char   filename[250];
+	double unit;
+	int    inc_max;
+	int    r;
+
+	unit = refine_unit((arg.Chan == 1) ? arg.V1_step : arg.V2_step, &inc_max);
+
+	// === create file names
+	snprintf(rig->filename_vac, 250, "%s/vac.dat", rig->dir);
+	snprintf(rig->filename_bin, 250, "%s/vac.bin", rig->dir);
+
+	// === build vac header, it is shared by vac.dat and vac.bin
+	hdr_fp = open_memstream(&rig->vac_header, &rig->vac_header_len);
+	if (hdr_fp == NULL)
+	{
+		fprintf(stderr, "# E: Unable to create vac header (%s)\n", strerror(errno));
+		goto rig_vac_fopen;
+	}
+
+	r = fprintf(hdr_fp,
+		"# Measuring of charge carrier mobility of thin films"
+			"in field effect transistor structure by the four probe method\n"
+		"# Id vs Vg\n"
+		"# Date: %04d.%02d.%02d %02d:%02d:%02d\n"
+		"# Start parameters:\n"
+		"#   sample_name      = %s\n"
+		"#   Chan             = %d\n"
+		"#   V1_start         = %le\n"
+		"#   V1_stop          = %le\n"
+		"#   V1_step          = %le\n"
+		"#   I1_max           = %le\n"
+		"#   V2_start         = %le\n"
+		"#   V2_stop          = %le\n"
+		"#   V2_step          = %le\n"
+		"#   I2_max           = %le\n"
+		"#   Delay            = %le\n"
+		"#   Settle           = %s\n"
+		"#   Settle_tol       = %le\n"
+		"#   Step             = %s\n"
+		"#   Step_min         = %le\n"
+		"#   Refine_tol       = %le\n"
+		"#   Ramp             = %le\n"
+		"#   Ramp_read        = %d\n"
+		"#   Profile          = %s\n"
+		"#   NPLC             = %le\n"
+		"#   Autozero         = %s\n"
+		"#   Filter           = %d\n"
+		"#   Measure_delay    = %s\n"
+		"#   Samples          = %d\n"
+		"#   Sem_tol          = %le\n"
+		"#   Sem_abs          = %le\n"
+		"#   Compliance       = %s\n"
+		"#   Fit_window       = %d\n"
+		"#   Mu_k             = %le\n"
+		"#   Early_stop       = %le\n"
+		"#   Timeout          = %le\n"
+		"#   Retries          = %d\n"
+		"#   Readback         = %s\n"
+		"#   Pipeline         = %s\n"
+		"#   Period           = %le\n"
+		"#   Realtime         = %s\n"
+		"#   Stress           = %le\n"
+		"#   Stress_interval  = %le\n"
+		"#   Stress_sweep     = %le\n"
+		"#   Recipe           = %s\n"
+		"#   Entry            = %d\n"
+		"#   Sweep            = %s\n"
+		"#   Dev              = %s\n"
+		"# 1: index\n"
+		"# 2: time, s\n"
+		"# 3: V1, V\n"
+		"# 4: I1, A\n"
+		"# 5: V2, V\n"
+		"# 6: I2, A\n"
+		"# 7: settle, s\n"
+		"# 8: I1 std, A\n"
+		"# 9: I2 std, A\n"
+		"# 10: samples\n"
+		"# 11: compliance, 1 - I1, 2 - I2\n",
+		start_time_struct.tm_year + 1900,
+		start_time_struct.tm_mon + 1,
+		start_time_struct.tm_mday,
+		start_time_struct.tm_hour,
+		start_time_struct.tm_min,
+		start_time_struct.tm_sec,
+		rig->sample_name,
+		arg.Chan,
+		arg.V1_start,
+		arg.V1_stop,
+		arg.V1_step,
+		arg.I1_max,
+		arg.V2_start,
+		arg.V2_stop,
+		arg.V2_step,
+		arg.I2_max,
+		arg.Delay,
+		(arg.Settle && !arg.Onboard) ? "adaptive" : "fixed",
+		arg.Settle_tol,
+		(inc_max > 1) ? "adaptive" : "uniform",
+		unit,
+		arg.Refine_tol,
+		arg.Ramp,
+		arg.Ramp_read,
+		arg.Profile->name,
+		arg.Profile->nplc,
+		arg.Profile->autozero,
+		arg.Profile->filter,
+		arg.Profile->delay,
+		arg.Samples,
+		arg.Sem_tol,
+		arg.Sem_abs,
+		(arg.Compliance == COMPLY_NEXT) ? "next" : (arg.Compliance == COMPLY_REVERSE) ? "reverse" : "off",
+		arg.Fit_window,
+		arg.Mu_k,
+		arg.Early_stop,
+		arg.Timeout,
+		arg.Retries,
+		arg.Separate ? "separate" : "combined",
+		pipelined() ? "on" : "off",
+		arg.Period,
+		arg.Rt ? "on" : "off",
+		arg.Stress,
+		arg.Stress_interval,
+		arg.Stress_sweep,
+		arg.Recipe ? arg.Recipe : "none",
+		arg.Entry,
+		(arg.Onboard || (arg.Stress > 0)) ? "onboard" : "host",
+		rig->dev
+	);
+	fclose(hdr_fp);
+	if(r < 0)
+	{
+		fprintf(stderr, "# E: Unable to create vac header\n");
+		goto rig_vac_header;
+	}
+
+	// === a resumed run continues the files after the last committed point
+	if (arg.Resume != NULL)
+	{
+		if (rig_reopen(rig) < 0)
+			goto rig_vac_header;
+		goto rig_timing;
+	}
+
+	// === create vac file
+	if (arg.Format & FMT_TEXT)
+	{
+		rig->vac_fp = fopen(rig->filename_vac, "w+");
+		if(rig->vac_fp == NULL)
+		{
+			fprintf(stderr, "# E: Unable to open file \"%s\" (%s)\n", rig->filename_vac, strerror(errno));
+			goto rig_vac_header;
+		}
+		// the sink thread flushes it once per batch
+		setvbuf(rig->vac_fp, NULL, _IOFBF, 1 << 16);
+
+		r = fputs(rig->vac_header, rig->vac_fp);
+		if(r == EOF)
+		{
+			fprintf(stderr, "# E: Unable to print to file \"%s\" (%s)\n", rig->filename_vac, strerror(errno));
+			goto rig_vac_bin;
+		}
+	}
+
+	// === create binary vac file
+	if (arg.Format & FMT_BIN)
+	{
+		memset(&bin_hdr, 0, sizeof(bin_hdr));
+		bin_hdr.chan       = arg.Chan;
+		bin_hdr.start_time = start_time;
+		bin_hdr.date[0]    = start_time_struct.tm_year + 1900;
+		bin_hdr.date[1]    = start_time_struct.tm_mon + 1;
+		bin_hdr.date[2]    = start_time_struct.tm_mday;
+		bin_hdr.date[3]    = start_time_struct.tm_hour;
+		bin_hdr.date[4]    = start_time_struct.tm_min;
+		bin_hdr.date[5]    = start_time_struct.tm_sec;
+		bin_hdr.V1_start   = arg.V1_start;
+		bin_hdr.V1_stop    = arg.V1_stop;
+		bin_hdr.V1_step    = arg.V1_step;
+		bin_hdr.I1_max     = arg.I1_max;
+		bin_hdr.V2_start   = arg.V2_start;
+		bin_hdr.V2_stop    = arg.V2_stop;
+		bin_hdr.V2_step    = arg.V2_step;
+		bin_hdr.I2_max     = arg.I2_max;
+		bin_hdr.delay      = arg.Delay;
+		snprintf(bin_hdr.sample_name, sizeof(bin_hdr.sample_name), "%s", rig->sample_name);
+		bin_hdr.text_size  = rig->vac_header_len;
+		bin_hdr.text       = rig->vac_header;
+
+		r = vacbin_create(&rig->bin_file, rig->filename_bin, &bin_hdr);
+		if (r < 0)
+		{
+			fprintf(stderr, "# E: Unable to create file \"%s\" (%s)\n", rig->filename_bin, strerror(-r));
+			goto rig_vac_bin;
+		}
+		rig->bin = &rig->bin_file;
+	}
+	rig_timing:
+
+	// === create timing files
+	r = timing_open(rig);
+	if (r < 0)
+		goto rig_timing_open;
+
+	// === open the journal, a new one starts with the header alone committed
+	snprintf(filename, 250, "%s/%s", rig->dir, JOURNAL_FILE);
+	r = journal_open(&rig->journal, filename, arg.Resume != NULL);
+	if (r < 0)
+	{
+		fprintf(stderr, "# E: Unable to open file \"%s\" (%s)\n", filename, strerror(-r));
+		goto rig_journal_open;
+	}
+	if (arg.Resume != NULL)
+		journal_start(&rig->journal, time(NULL), 1);
+	else
+	{
+		journal_args(&rig->journal, rig->id, arg.Words);
+		journal_start(&rig->journal, start_time, 0);
+
+		memset(&rig->commit, 0, sizeof(struct point));
+		rig->commit.index = -1;
+		rig->uncommitted  = 1;
+		rig_commit(rig);
+	}
+
+	analyze_open(rig);
+
+	return 0;
+
+	rig_journal_open:
+
+	if (rig->timing_fp != NULL)
+		fclose(rig->timing_fp);
+	rig->timing_fp = NULL;
+	rig_timing_open:
+
+	if (rig->bin != NULL)
+		vacbin_close(rig->bin);
+	rig->bin = NULL;
+	rig_vac_bin:
+
+	if (rig->vac_fp != NULL)
+		fclose(rig->vac_fp);
+	rig->vac_fp = NULL;
+	rig_vac_header:
+
+	free(rig->vac_header);
+	rig->vac_header = NULL;
+	rig_vac_fopen:
+
+	return -1;
+}
+
+// continue vac.dat and vac.bin of a resumed run after the last committed
+// point, the rest of them is cut off
+static int rig_reopen(struct rig *rig)
+{
+	struct stat st;
+	int r;
+
+	if (arg.Format & FMT_TEXT)
+	{
+		rig->vac_fp = fopen(rig->filename_vac, "r+");
+		r = (rig->vac_fp == NULL) ? -errno : 0;
+		if (r == 0)
+			setvbuf(rig->vac_fp, NULL, _IOFBF, 1 << 16);
+		if ((r == 0) && (fstat(fileno(rig->vac_fp), &st) < 0))
+			r = -errno;
+		if ((r == 0) && (st.st_size < resume.point.dat_size))
+			r = -EINVAL;
+		if ((r == 0) && ((ftruncate(fileno(rig->vac_fp), resume.point.dat_size) < 0) ||
+			(fseek(rig->vac_fp, 0, SEEK_END) < 0)))
+			r = -errno;
+		if (r < 0)
+		{
+			fprintf(stderr, "# E: Unable to continue file \"%s\" (%s)\n", rig->filename_vac, strerror(-r));
+			goto reopen_vac;
+		}
+	}
+
+	if (arg.Format & FMT_BIN)
+	{
+		r = vacbin_reopen(&rig->bin_file, rig->filename_bin, resume.point.bin_records);
+		if (r < 0)
+		{
+			fprintf(stderr, "# E: Unable to continue file \"%s\" (%s)\n", rig->filename_bin, strerror(-r));
+			goto reopen_vac;
+		}
+		rig->bin = &rig->bin_file;
+	}
+
+	return 0;
+
+	reopen_vac:
+
+	if (rig->vac_fp != NULL)
+		fclose(rig->vac_fp);
+	rig->vac_fp = NULL;
+
+	return -1;
+}
+
+// write the latency summary and close the files, the sink is stopped or paused
+static void rig_close(struct rig *rig)
+{
+	int r;
+
+	if (rig->vac_header == NULL)
+		return;
+
+	rig_commit(rig);
+	journal_close(&rig->journal);
+
+	timing_summary(rig);
+	analyze_summary(rig);
+
+	if (rig->bin != NULL)
+	{
+		r = vacbin_close(rig->bin);
+		if (r < 0)
+			fprintf(stderr, "# E: Unable to close file \"%s\" (%s)\n", rig->filename_bin, strerror(-r));
+	}
+
+	if (rig->vac_fp != NULL)
+	{
+		r = fclose(rig->vac_fp);
+		if (r == EOF)
+		{
+			fprintf(stderr, "# E: Unable to close file \"%s\" (%s)\n", rig->filename_vac, strerror(errno));
+		}
+	}
+
+	free(rig->vac_header);
+	rig->vac_header = NULL;
+}
+
+// start an entry: the directories and the output files of all rigs,
+// named after the start time of the entry, a resumed run continues the
+// files and the time of its directory
+static int entry_open(const char **names)
+{
+	struct rig *rig;
+	double elapsed;
+	int status;
+	int i, k, n;
+
+	start_time = (arg.Resume != NULL) ? resume.start_time : time(NULL);
+	localtime_r(&start_time, &start_time_struct);
+
+	for (k = 0; k < nrigs; k++)
+	{
+		rig = &rigs[k];
+		rig->sample_name = arg.sample_name[k];
+		rig->time_first  = 0;
+		rig->overruns    = 0;
+		rig->plot_next   = 0.0;
+		rig->uncommitted = 0;
+		rig->t_commit    = 0;
+		atomic_store(&rig->next, 0);
+		atomic_store(&rig->converged, 0);
+		names[k] = rig->sample_name;
+		telemetry_entry(&telemetry, k, arg.Chan, rig->sample_name);
+
+		if (arg.Resume != NULL)
+		{
+			n = snprintf(rig->dir, 200, "%s", arg.Resume);
+			while ((n > 1) && (rig->dir[n - 1] == '/'))
+				rig->dir[--n] = '\0';
+
+			// the points go on from the wall clock time since the start
+			elapsed = fmax(difftime(time(NULL), start_time), resume.point.time);
+			rig->time_t0    = lat_now() - (uint64_t) (elapsed * 1e9);
+			rig->time_first = 1;
+
+			if (rig_open(rig) < 0)
+				return -4;
+			continue;
+		}
+
+		// === create dirictory in "20191012_153504_<experiment_name>" format
+		n = snprintf(rig->dir, 200, "%04d-%02d-%02d_%02d-%02d-%02d_%s",
+			start_time_struct.tm_year + 1900,
+			start_time_struct.tm_mon + 1,
+			start_time_struct.tm_mday,
+			start_time_struct.tm_hour,
+			start_time_struct.tm_min,
+			start_time_struct.tm_sec,
+			rig->sample_name
+		);
+		status = mkdir(rig->dir, S_IRWXU | S_IRWXG | S_IROTH | S_IXOTH);
+
+		// recipe entries of one sample started within a second
+		for (i = 2; (status == -1) && (errno == EEXIST) && (arg.Entry > 0) && (n < 190) && (i < 100); i++)
+		{
+			snprintf(rig->dir + n, 200 - n, "_%d", i);
+			status = mkdir(rig->dir, S_IRWXU | S_IRWXG | S_IROTH | S_IXOTH);
+		}
+		if (status == -1)
+		{
+			fprintf(stderr, "# E: unable to create experiment directory \"%s\" (%s)\n", rig->dir, strerror(errno));
+			return -2;
+		}
+
+		if (rig_open(rig) < 0)
+			return -4;
+	}
+
+	return 0;
+}
+
+// plot axis of the entry, a stress run is shown against time and the
+// interruption sweeps make it longer than --stress
+static void plot_range(int *xcol, double *xmin, double *xmax)
+{
+	if (arg.Stress > 0)
+	{
+		*xcol = 2;
+		*xmin = 0.0;
+		*xmax = (arg.Stress_sweep > 0) ? INFINITY : arg.Stress;
+		return;
+	}
+
+	*xcol = (arg.Chan == 1) ? 3 : 5;
+	*xmin = (arg.Chan == 1) ? arg.V1_start : arg.V2_start;
+	*xmax = (arg.Chan == 1) ? arg.V1_stop  : arg.V2_stop;
+}
+
+// === recipe
+// every line is an entry of options and sample names parsed on top of the
+// command line arguments, "#" starts a comment
+#define RECIPE_ARGS 64 // words per line
+
+// returns the number of entries or negative value on error
+static int recipe_load(const char *filename, const struct arguments *base, struct arguments **entries)
+{
+	struct arguments *e = NULL;
+	struct arguments *tmp;
+	char *argv[RECIPE_ARGS + 1];
+	char *line = NULL;
+	char *save, *w;
+	size_t len = 0;
+	int argc;
+	int count = 0;
+	int lineno = 0;
+	int r = 0;
+	FILE *fp;
+
+	fp = fopen(filename, "r");
+	if (fp == NULL)
+	{
+		fprintf(stderr, "# E: Unable to open recipe \"%s\" (%s)\n", filename, strerror(errno));
+		return -1;
+	}
+
+	while (getline(&line, &len, fp) != -1)
+	{
+		lineno++;
+
+		argv[0] = "fet4p";
+		argc = 1;
+		for (w = strtok_r(line, " \t\r\n", &save); (w != NULL) && (*w != '#'); w = strtok_r(NULL, " \t\r\n", &save))
+		{
+			if (argc == RECIPE_ARGS)
+			{
+				fprintf(stderr, "# E: %s:%d: more than %d words\n", filename, lineno, RECIPE_ARGS - 1);
+				r = -1;
+				break;
+			}
+			argv[argc++] = w;
+		}
+		if (r < 0)
+			break;
+		if (argc == 1)
+			continue;
+		argv[argc] = NULL;
+
+		tmp = realloc(e, (count + 1) * sizeof(struct arguments));
+		if (tmp == NULL)
+		{
+			fprintf(stderr, "# E: Unable to load recipe (%s)\n", strerror(ENOMEM));
+			r = -1;
+			break;
+		}
+		e = tmp;
+		e[count] = *base;
+		e[count].Entry = lineno;
+		e[count].Words = words_join(base->Words, argc - 1, argv + 1);
+		if (e[count].Words == NULL)
+		{
+			fprintf(stderr, "# E: Unable to load recipe (%s)\n", strerror(ENOMEM));
+			r = -1;
+			break;
+		}
+
+		if ((argp_parse(&argp, argc, argv, ARGP_NO_EXIT, 0, &e[count]) != 0) ||
+			(e[count].sample_name_flag != 1) || (e[count].Delay_flag != 1))
+		{
+			fprintf(stderr, "# E: %s:%d: error while parsing the entry, --delay and <sample_name> are required\n",
+				filename, lineno);
+			r = -1;
+			break;
+		}
+		if (e[count].Devs != base->Devs)
+		{
+			fprintf(stderr, "# E: %s:%d: <dev> is given on the command line only\n", filename, lineno);
+			r = -1;
+			break;
+		}
+		if (e[count].sample_names != base->Devs)
+		{
+			fprintf(stderr, "# E: %s:%d: %d <sample_name> for %d <dev>\n",
+				filename, lineno, e[count].sample_names, base->Devs);
+			r = -1;
+			break;
+		}
+		count++;
+
+		// the entry keeps pointers into its line
+		line = NULL;
+		len  = 0;
+	}
+	free(line);
+	fclose(fp);
+
+	if ((r == 0) && (count == 0))
+	{
+		fprintf(stderr, "# E: No entries in recipe \"%s\"\n", filename);
+		r = -1;
+	}
+	if (r < 0)
+	{
+		free(e);
+		return r;
+	}
+
+	*entries = e;
+	return count;
+}
+
+// words separated by spaces after <head>, NULL if out of memory
+static char *words_join(const char *head, int argc, char **argv)
+{
+	char *s;
+	size_t len, n;
+	int k;
+
+	len = (head != NULL) ? strlen(head) + 1 : 1;
+	for (k = 0; k < argc; k++)
+		len += strlen(argv[k]) + 1;
+
+	s = malloc(len);
+	if (s == NULL)
+		return NULL;
+
+	n = snprintf(s, len, "%s", (head != NULL) ? head : "");
+	for (k = 0; k < argc; k++)
+		n += snprintf(s + n, len - n, "%s%s", (n > 0) ? " " : "", argv[k]);
+
+	return s;
+}
+
+// === resume
+// the arguments of a resumed run are the ones of its journal with the
+// command line ones on top, the rig is the instrument and the sample of
+// the directory
+static int resume_load(const struct arguments *defaults, int argc, char **argv)
+{
+	struct arguments a = *defaults;
+	char path[250];
+	int r;
+
+	if ((arg.Devs > 0) || (arg.sample_names > 0) || (arg.Recipe != NULL))
+	{
+		fprintf(stderr, "# E: <dev>, <sample_name> and <recipe> of a resumed run are in its journal\n");
+		return -1;
+	}
+
+	snprintf(path, sizeof(path), "%s/%s", arg.Resume, JOURNAL_FILE);
+	r = journal_read(&resume, path);
+	if (r < 0)
+	{
+		fprintf(stderr, "# E: Unable to read journal \"%s\" (%s)\n", path, strerror(-r));
+		return -1;
+	}
+	if (resume.points == 0)
+	{
+		fprintf(stderr, "# E: %s: no committed point in the journal\n", path);
+		return -1;
+	}
+
+	if ((argp_parse(&argp, resume.argc, resume.argv, ARGP_NO_EXIT, 0, &a) != 0) ||
+		(argp_parse(&argp, argc, argv, ARGP_NO_EXIT, 0, &a) != 0) ||
+		(a.sample_name_flag != 1) || (a.Delay_flag != 1))
+	{
+		fprintf(stderr, "# E: %s: error while parsing the arguments of the run\n", path);
+		return -1;
+	}
+
+	if (a.Devs == 0)
+		a.Dev[a.Devs++] = INS_DEV_FILE;
+	if ((resume.rig < 0) || (resume.rig >= a.Devs) || (resume.rig >= a.sample_names))
+	{
+		fprintf(stderr, "# E: %s: no <dev> %d in the arguments of the run\n", path, resume.rig + 1);
+		return -1;
+	}
+	if (a.Stress > 0)
+	{
+		fprintf(stderr, "# E: %s: a bias stress run can not be resumed\n", path);
+		return -1;
+	}
+
+	a.Dev[0]         = a.Dev[resume.rig];
+	a.sample_name[0] = a.sample_name[resume.rig];
+	a.Devs           = 1;
+	a.sample_names   = 1;
+	a.Recipe         = NULL;
+	a.Entry          = 0;
+	a.Words          = NULL;
+	arg = a;
+
+	fprintf(stderr, "# Resume %s: %s after point %d of stage %d at %lf V, %.3lf s\n",
+		arg.Resume, arg.sample_name[0], resume.point.index, resume.point.stage,
+		resume.point.voltage, resume.point.time);
+	return 0;
+}
+
+
+// === utils
+static int get_run()
+{
+	return atomic_load(&run);
+}
+
+static void set_run(int run_new)
+{
+	uint64_t one = 1;
+	int k;
+
+	atomic_store(&run, run_new);
+	if (run_new == 0)
+		for (k = 0; k < nrigs; k++)
+			write(rigs[k].event_fd, &one, sizeof(one));
+}
+
+static int get_next(struct rig *rig)
+{
+	return atomic_load(&rig->next);
+}
+
+static void set_next(struct rig *rig, int next_new)
+{
+	uint64_t one = 1;
+
+	atomic_store(&rig->next, next_new);
+	if (next_new != 0)
+		write(rig->event_fd, &one, sizeof(one));
+}
+
+// the converged estimates end stage 2 as "next stage" does, a request
+// that comes in once the worker is past stage 2 is dropped
+static int take_converged(struct rig *rig, int stage)
+{
+	return atomic_exchange(&rig->converged, 0) && (stage == M_STAGE2);
+}
+
+// sleep until the CLOCK_MONOTONIC deadline, ns, returns 1 as soon as "quit"
+// or "next stage" is requested, the last PACE_SLEEP is an absolute
+// clock_nanosleep so the wake-up does not depend on the poll granularity
+static int wait_until(struct rig *rig, uint64_t deadline)
+{
+	struct pollfd pfd = {rig->event_fd, POLLIN, 0};
+	struct timespec ts;
+	uint64_t count, now;
+	double left;
+
+	for (;;)
+	{
+		if (!get_run() || get_next(rig))
+			return 1;
+
+		now = lat_now();
+		if (now >= deadline)
+			return 0;
+
+		left = (deadline - now) / 1e9;
+		if (left <= PACE_SLEEP)
+			break;
+
+		if (poll(&pfd, 1, floor((left - PACE_SLEEP) * 1e3)) > 0)
+			read(rig->event_fd, &count, sizeof(count));
+	}
+
+	ts.tv_sec  = deadline / 1000000000ULL;
+	ts.tv_nsec = deadline % 1000000000ULL;
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+		;
+	return 0;
+}
+
+// sleep for t seconds, returns 1 as soon as "quit" or "next stage" is requested
+static int wait_delay(struct rig *rig, double t)
+{
+	if (t <= 0)
+		return (!get_run() || get_next(rig));
+	return wait_until(rig, lat_now() + (uint64_t) (t * 1e9));
+}
+
+// next slot of the --period grid from *deadline, 0 starts the grid now,
+// the slots a late point has missed are skipped and counted
+static int pace_point(struct rig *rig, uint64_t *deadline)
+{
+	uint64_t period = arg.Period * 1e9;
+	uint64_t now = lat_now();
+	uint64_t missed;
+	int r;
+
+	if (*deadline == 0)
+		*deadline = now;
+	else
+		*deadline += period;
+
+	if (now >= *deadline + period)
+	{
+		missed = (now - *deadline) / period;
+		*deadline      += missed * period;
+		rig->overruns += missed;
+	}
+
+	r = wait_until(rig, *deadline);
+	if (r)
+		return r;
+
+	rig->phase_ns[PH_LAG] = lat_now() - *deadline;
+	lat_record(&rig->phase_hist[PH_LAG], rig->phase_ns[PH_LAG]);
+	return 0;
+}
+
+// SCHED_FIFO and the CPU of the calling rig thread, failures only warn
+static void rt_enter(struct rig *rig)
+{
+	struct sched_param sp = {.sched_priority = RT_PRIO};
+	cpu_set_t set;
+	int r;
+
+	r = pthread_setschedparam(pthread_self(), SCHED_FIFO, &sp);
+	if (r != 0)
+		fprintf(stderr, "# W: %s: Unable to set SCHED_FIFO (%s)\n", rig->dev, strerror(r));
+
+	if (arg.Rt_cpu < 0)
+		return;
+
+	CPU_ZERO(&set);
+	CPU_SET((arg.Rt_cpu + rig->id) % CPU_SETSIZE, &set);
+	r = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+	if (r != 0)
+		fprintf(stderr, "# W: %s: Unable to pin to CPU %d (%s)\n", rig->dev, arg.Rt_cpu + rig->id, strerror(r));
+}
+
+// async-signal-safe: lock-free atomic store and write(2) only
+static void on_sigint(int sig)
+{
+	(void) sig;
+	set_run(0);
+}
+
+static double get_time(struct rig *rig)
+{
+	if (rig->time_first == 0)
+	{
+		rig->time_t0    = lat_now();
+		rig->time_first = 1;
+		return 0.0;
+	}
+
+	return (lat_now() - rig->time_t0) / 1e9;
+}
+
+static int direction(double start, double stop)
+{
+	return (stop >= start) ? 1 : -1;
+}
+
+// the next setpoint goes out with the combined readback, paced points
+// set their level at the deadline instead
+static int pipelined(void)
+{
+	return arg.Pipeline && !arg.Separate && !arg.Onboard && (arg.Period <= 0);
+}
+
+// read V1, I1, V2, I2 of both channels
+// combined mode takes one iv() measurement per channel and returns all four
+// values in a single response line; separate mode keeps the legacy four queries
+// a <next> voltage other than NAN is set on the scanning channel in the same
+// chunk right after the readback, combined mode only
+static int read_point(struct rig *rig, struct instrument *ins, double next, double *V1, double *I1, double *V2, double *I2)
+{
+	char  buf[300];
+	char  level[64] = "";
+	int   r;
+
+	if (arg.Separate)
+	{
+		if (read_value(rig, ins, "print(smua.measure.v())\n", V1, PH_READ_V1) < 0) return -1;
+		if (read_value(rig, ins, "print(smua.measure.i())\n", I1, PH_READ_I1) < 0) return -1;
+		if (read_value(rig, ins, "print(smub.measure.v())\n", V2, PH_READ_V2) < 0) return -1;
+		if (read_value(rig, ins, "print(smub.measure.i())\n", I2, PH_READ_I2) < 0) return -1;
+		return 0;
+	}
+
+	if (!isnan(next))
+		snprintf(level, sizeof(level), " %s.source.levelv = %lf", (arg.Chan == 1) ? "smua" : "smub", next);
+
+	r = ins_query(ins, buf, 300,
+		"ia, va = smua.measure.iv() "
+		"ib, vb = smub.measure.iv() "
+		"print(va, ia, vb, ib)%s\n", level);
+	if (r < 0)
+	{
+		fprintf(stderr, "# E: Unable to read from device (%s)\n", strerror(-r));
+		return -1;
+	}
+
+	r = sscanf(buf, "%lf %lf %lf %lf", V1, I1, V2, I2);
+	if (r != 4)
+	{
+		fprintf(stderr, "# E: Unable to parse device response (%s)\n", buf);
+		return -2;
+	}
+
+	return 0;
+}
+
+static int read_value(struct rig *rig, struct instrument *ins, const char *cmd, double *value, int ph)
+{
+	char  buf[300];
+	int   r;
+	uint64_t t = lat_now();
+
+	r = ins_query(ins, buf, 300, "%s", cmd);
+	if (r < 0)
+	{
+		fprintf(stderr, "# E: Unable to read from device (%s)\n", strerror(-r));
+		return -1;
+	}
+	sscanf(buf, "%lf", value);
+	phase_mark(rig, ph, &t);
+
+	return 0;
+}
+
+// wait until the point is settled, the level was set at t_level
+// fixed mode waits --delay, adaptive mode samples both currents until two
+// consecutive readings agree within --settle_tol and waits --delay at most
+// returns 1 on "quit" or "next stage" request and negative value on error
+static int settle_point(struct rig *rig, struct instrument *ins, uint64_t t_level, double *settle)
+{
+	char   buf[300];
+	double I[2], last[2];
+	double t, t_sample;
+	uint64_t t_start;
+	int    n, k, stable;
+	int    r;
+
+	if (!arg.Settle)
+	{
+		r = wait_delay(rig, arg.Delay - (lat_now() - t_level) / 1e9);
+		*settle = (lat_now() - t_level) / 1e9;
+		return r;
+	}
+
+	for (n = 0; ; n++)
+	{
+		if (!get_run() || get_next(rig))
+			return 1;
+
+		t_start = lat_now();
+		r = ins_query(ins, buf, 300, "print(smua.measure.i(), smub.measure.i())\n");
+		if (r < 0)
+		{
+			fprintf(stderr, "# E: Unable to read from device (%s)\n", strerror(-r));
+			return -1;
+		}
+		if (sscanf(buf, "%lf %lf", &I[0], &I[1]) != 2)
+		{
+			fprintf(stderr, "# E: Unable to parse device response (%s)\n", buf);
+			return -2;
+		}
+
+		t = lat_now();
+		t_sample = (t - t_start) / 1e9;
+		*settle  = (t - t_level) / 1e9;
+
+		stable = (n > 0);
+		for (k = 0; (k < 2) && stable; k++)
+			if (fabs(I[k] - last[k]) > arg.Settle_tol * fmax(fabs(I[k]), fabs(last[k])) + SETTLE_FLOOR)
+				stable = 0;
+		if (stable)
+			return 0;
+
+		// the next sample would end past the upper bound, wait it out instead
+		if (*settle + t_sample > arg.Delay)
+		{
+			r = wait_delay(rig, arg.Delay - *settle);
+			*settle = (lat_now() - t_level) / 1e9;
+			return r;
+		}
+
+		last[0] = I[0];
+		last[1] = I[1];
+	}
+}
+
+// average up to n_max readings, stop when the standard error of the mean
+// of both currents is below --sem_tol of the mean or --sem_abs
+// fills V1, I1, V2, I2, I1_std, I2_std and samples of p
+// returns 1 when <next> went out with the n_max-th reading, see read_point
+static int sample_point(struct rig *rig, struct instrument *ins, int n_max, double next, struct point *p)
+{
+	double V1, I1, V2, I2;
+	double d1, d2, M1, M2, sem1, sem2;
+	int n, r;
+	int preset = 0;
+
+	p->V1 = p->I1 = p->V2 = p->I2 = 0.0;
+	M1 = M2 = 0.0;
+
+	// running mean and sum of squared deviations (Welford)
+	for (n = 1; n <= n_max; n++)
+	{
+		// only the last possible reading may move the level
+		r = read_point(rig, ins, (n == n_max) ? next : NAN, &V1, &I1, &V2, &I2);
+		if (r < 0)
+			return r;
+		preset = (n == n_max) && !isnan(next);
+
+		d1 = I1 - p->I1;
+		d2 = I2 - p->I2;
+		p->V1 += (V1 - p->V1) / n;
+		p->I1 += d1 / n;
+		p->V2 += (V2 - p->V2) / n;
+		p->I2 += d2 / n;
+		M1 += d1 * (I1 - p->I1);
+		M2 += d2 * (I2 - p->I2);
+
+		if ((n < SAMPLE_MIN) || (n == n_max))
+			continue;
+
+		sem1 = sqrt(M1 / (n - 1) / n);
+		sem2 = sqrt(M2 / (n - 1) / n);
+		if ((sem1 <= fmax(arg.Sem_tol * fabs(p->I1), arg.Sem_abs)) &&
+			(sem2 <= fmax(arg.Sem_tol * fabs(p->I2), arg.Sem_abs)))
+			break;
+
+		// "quit" and "next stage" keep the readings taken so far
+		if (!get_run() || get_next(rig))
+			break;
+	}
+	if (n > n_max)
+		n = n_max;
+
+	p->samples = n;
+	p->I1_std  = (n > 1) ? sqrt(M1 / (n - 1)) : NAN;
+	p->I2_std  = (n > 1) ? sqrt(M2 / (n - 1)) : NAN;
+
+	return preset;
+}
+
+// flag the currents of p that are at their limits
+static int comply_point(struct point *p)
+{
+	p->compliance = 0;
+	if (fabs(p->I1) >= COMPLY_FRAC * arg.I1_max)
+		p->compliance |= 1;
+	if (fabs(p->I2) >= COMPLY_FRAC * arg.I2_max)
+		p->compliance |= 2;
+	return p->compliance;
+}
+
+// refinement splits the channel step into inc_max steps of at most --step_min,
+// the uniform sweep uses one step of V_step
+static double refine_unit(double V_step, int *inc_max)
+{
+	double unit;
+
+	if (!arg.Refine || arg.Onboard)
+	{
+		*inc_max = 1;
+		return V_step;
+	}
+
+	unit = (arg.Step_min > 0.0) ? fmin(arg.Step_min, V_step) : V_step / REFINE_DIV;
+	*inc_max = ceil(V_step / unit - 1e-9);
+
+	return V_step / *inc_max;
+}
+
+// next step in units of the minimum step from the drain current change
+// between the last two points, the sweep never goes back so a steep part of
+// the curve is refined starting from the point after the one that hit it
+static int refine_step(double I_prev, double I, int inc, int inc_max)
+{
+	double d = fabs(log10(fabs(I) + REFINE_FLOOR) - log10(fabs(I_prev) + REFINE_FLOOR));
+
+	if (d > arg.Refine_tol)
+		inc = inc * arg.Refine_tol / d;
+	else if (d < arg.Refine_tol / 2)
+		inc *= 2;
+
+	if (inc < 1)
+		inc = 1;
+	if (inc > inc_max)
+		inc = inc_max;
+
+	return inc;
+}
+
+// compile the stages after <stage> again when "next stage" ended it at <voltage>,
+// a negative <V_step> starts the next stage one step back instead of forward
+static int plan_next(struct rig *rig, struct plan *plan, int stage, double voltage, double *V_start, double *V_stop, double V_step)
+{
+	int r;
+
+	if (stage == M_STAGE1)
+		*V_start = voltage + V_step * direction(0.0, *V_start);
+	else
+		*V_stop = voltage + V_step * direction(*V_start, *V_stop);
+
+	r = plan_build(plan, stage + 1, *V_start, *V_stop, plan->unit);
+	if (r < 0)
+		fprintf(stderr, "# E: Unable to compile sweep plan (%s)\n", strerror(-r));
+	else
+		rig_plan(rig, stage + 1, *V_start, *V_stop, 0);
+	return r;
+}
+
+// compile stage 2 again from one step before <voltage> back to V_start,
+// returns 1 if <voltage> is too close to V_start to turn around
+static int plan_reverse(struct rig *rig, struct plan *plan, double voltage, double *V_start, double *V_stop, double V_step)
+{
+	int r;
+
+	if (fabs(voltage - *V_start) <= V_step)
+		return 1;
+
+	*V_stop  = *V_start;
+	*V_start = voltage + V_step * direction(voltage, *V_stop);
+
+	r = plan_build(plan, M_STAGE2, *V_start, *V_stop, plan->unit);
+	if (r < 0)
+		fprintf(stderr, "# E: Unable to compile sweep plan (%s)\n", strerror(-r));
+	else
+		rig_plan(rig, M_STAGE2, *V_start, *V_stop, 1);
+	return r;
+}
+
+// journal a compiled plan, the points handed to the sink so far were
+// taken before it
+static void rig_plan(struct rig *rig, int stage, double V_start, double V_stop, int reversed)
+{
+	struct journal_plan jp;
+
+	jp.stage    = stage;
+	jp.V_start  = V_start;
+	jp.V_stop   = V_stop;
+	jp.reversed = reversed;
+	jp.last     = rig->last_index;
+	journal_plan(&rig->journal, &jp);
+}
+
+// plan point after the last committed one, a point taken before the plan
+// was compiled, or of a stage it has not, leaves all of it to measure
+static int resume_point(const struct plan *plan)
+{
+	const struct journal_point *p = &resume.point;
+	int best = -1;
+	int k;
+
+	if ((resume.plans > 0) && (p->index <= resume.plan.last))
+		return 0;
+	if ((p->stage < M_STAGE1) || (p->stage > M_STAGE3))
+		return 0;
+
+	for (k = plan->first[p->stage]; k < plan->first[p->stage + 1]; k++)
+		if ((best < 0) || (fabs(plan->pt[k].voltage - p->voltage) < fabs(plan->pt[best].voltage - p->voltage)))
+			best = k;
+
+	return (best < 0) ? 0 : best + 1;
+}
+
+// bring the scanning channel of a resumed run from 0 V to <target> in
+// steps of V_step without readings, at the ramp rate or one per delay,
+// returns 1 if "quit" is requested
+static int resume_ramp(struct rig *rig, struct instrument *ins, double target, double V_step)
+{
+	double dt = (arg.Ramp > 0) ? V_step / arg.Ramp : arg.Delay;
+	int n = ceil(fabs(target) / V_step);
+	int i;
+
+	for (i = 1; i <= n; i++)
+	{
+		if (!get_run())
+			return 1;
+
+		if (arg.Chan == 1)
+			ins_printf(ins, "smua.source.levelv = %lf\n", target * i / n);
+		else
+			ins_printf(ins, "smub.source.levelv = %lf\n", target * i / n);
+
+		// "next stage" is left to the sweep, the ramp keeps its pace
+		if (wait_delay(rig, dt) && get_run())
+			usleep(dt * 1e6);
+	}
+
+	return !get_run();
+}
+
+// hand the point over to the sink thread
+static int output_point(struct rig *rig, const struct point *p)
+{
+	uint64_t t = lat_now();
+
+	ring_push(&rig->ring, p);
+	telemetry_point(&telemetry, rig->id, p);
+	phase_mark(rig, PH_PUSH, &t);
+	rig->last_index = p->index;
+
+	return atomic_load(&rig->sink->error) ? -1 : 0;
+}
+
+// === output sink
+static int sink_start(struct sink *sink, struct rig *rigs, int nrigs, struct plot *plot)
+{
+	int k;
+
+	for (k = 0; k < nrigs; k++)
+	{
+		if (ring_init(&rigs[k].ring, RING_SIZE) < 0)
+		{
+			while (k-- > 0)
+				ring_free(&rigs[k].ring);
+			return -1;
+		}
+		rigs[k].sink = sink;
+	}
+
+	sink->rigs   = rigs;
+	sink->nrigs  = nrigs;
+	sink->plot   = plot;
+	atomic_init(&sink->error, 0);
+	atomic_init(&sink->stop, 0);
+	atomic_init(&sink->pause, 0);
+
+	if (pthread_create(&sink->thread, NULL, sink_thread, sink) != 0)
+	{
+		for (k = 0; k < nrigs; k++)
+			ring_free(&rigs[k].ring);
+		return -2;
+	}
+
+	return 0;
+}
+
+// drain the rings, join the thread and free the rings
+static void sink_stop(struct sink *sink)
+{
+	int k;
+
+	atomic_store(&sink->pause, 0);
+	atomic_store(&sink->stop, 1);
+	pthread_join(sink->thread, NULL);
+
+	for (k = 0; k < sink->nrigs; k++)
+		ring_free(&sink->rigs[k].ring);
+}
+
+// wait until the rings are drained and the thread leaves the files and
+// the plot alone, the producers are stopped
+static void sink_pause(struct sink *sink)
+{
+	struct timespec ts = {0, SINK_POLL * 1e9};
+
+	atomic_store(&sink->pause, 1);
+	while (atomic_load(&sink->pause) != 2)
+		nanosleep(&ts, NULL);
+}
+
+// the rings start counting a new run
+static void sink_resume(struct sink *sink)
+{
+	int k;
+
+	for (k = 0; k < sink->nrigs; k++)
+		ring_reset(&sink->rigs[k].ring);
+	atomic_store(&sink->pause, 0);
+}
+
+// journal the last point written to the files of a rig once vac.dat and
+// vac.bin are flushed, a failing journal is closed and the run goes on
+static void rig_commit(struct rig *rig)
+{
+	struct journal_point jp;
+	long size = 0;
+	int r = 0;
+
+	if (!rig->uncommitted || (rig->journal.fd < 0))
+		return;
+	rig->uncommitted = 0;
+	rig->t_commit    = lat_now();
+
+	if (rig->vac_fp != NULL)
+	{
+		if (fflush(rig->vac_fp) == EOF)
+			return;
+		size = ftell(rig->vac_fp);
+		if (size < 0)
+			return;
+	}
+	if ((rig->bin != NULL) && (vacbin_flush(rig->bin) < 0))
+		return;
+
+	jp.index       = rig->commit.index;
+	jp.stage       = rig->commit.stage;
+	jp.voltage     = (arg.Chan == 1) ? rig->commit.V1 : rig->commit.V2;
+	jp.time        = rig->commit.time;
+	jp.dat_size    = size;
+	jp.bin_records = (rig->bin != NULL) ? rig->bin->records : 0;
+
+	r = journal_point(&rig->journal, &jp);
+	if (r < 0)
+	{
+		fprintf(stderr, "# W: Unable to write to the journal of \"%s\" (%s)\n", rig->dir, strerror(-r));
+		journal_close(&rig->journal);
+	}
+}
+
+// write one batch of a rig to its files and to the plot
+static void sink_batch(struct sink *sink, struct rig *rig, const struct point *p, size_t n)
+{
+	char title[PLOT_NOTE];
+	uint64_t t;
+	size_t k;
+	int r;
+
+	t = lat_now();
+	r = 0;
+	for (k = 0; (k < n) && (rig->vac_fp != NULL); k++)
+	{
+		r = vac_print_point(rig->vac_fp, &p[k]);
+		if (r < 0)
+			break;
+	}
+	if ((r < 0) || ((rig->vac_fp != NULL) && (fflush(rig->vac_fp) == EOF)))
+	{
+		fprintf(stderr, "# E: Unable to print to file \"%s\" (%s)\n", rig->filename_vac, strerror(errno));
+		atomic_store(&sink->error, 1);
+		set_run(0);
+		return;
+	}
+
+	// binary records are written in VACBIN_BUF blocks and on idle
+	for (k = 0; (k < n) && (rig->bin != NULL); k++)
+	{
+		r = vacbin_append(rig->bin, &p[k]);
+		if (r < 0)
+			break;
+	}
+	if (r < 0)
+	{
+		fprintf(stderr, "# E: Unable to write to file \"%s\" (%s)\n", rig->filename_bin, strerror(-r));
+		atomic_store(&sink->error, 1);
+		set_run(0);
+		return;
+	}
+	phase_mark(rig, PH_FILE, &t);
+	rig->commit      = p[n - 1];
+	rig->uncommitted = 1;
+
+	// converged estimates end stage 2 once the worker sees it, a stress
+	// run keeps its interruption sweeps whole
+	for (k = 0; k < n; k++)
+	{
+		if (analyze_point(&rig->analyze, &p[k]) && (arg.Early_stop > 0) && (arg.Stress <= 0))
+		{
+			fprintf(stderr, "# %s: stage 2 parameters converged at %lf V\n", rig->sample_name,
+				(arg.Chan == 1) ? p[k].V1 : p[k].V2);
+			atomic_store(&rig->converged, 1);
+		}
+	}
+	if (rig->analyze.points > 0)
+	{
+		analyze_title(&rig->analyze, title, sizeof(title));
+		plot_note(sink->plot, rig->id, title);
+	}
+
+	// a long stress is thinned out to STRESS_PLOT points, sweeps are kept
+	for (k = 0; k < n; k++)
+	{
+		if ((arg.Stress > 0) && (p[k].stage == STRESS_STAGE))
+		{
+			if (p[k].time < rig->plot_next)
+				continue;
+			rig->plot_next = p[k].time + arg.Stress / STRESS_PLOT;
+		}
+
+		r = plot_point(sink->plot, rig->id, p[k].index, p[k].time, p[k].V1, p[k].I1, p[k].V2, p[k].I2);
+		if (r < 0)
+		{
+			fprintf(stderr, "# E: Unable to print to gp (%s)\n", strerror(-r));
+			atomic_store(&sink->error, 1);
+			set_run(0);
+			break;
+		}
+	}
+	phase_mark(rig, PH_PLOT, &t);
+}
+
+static void *sink_thread(void *a)
+{
+	struct sink *sink = a;
+	struct point p[SINK_BATCH];
+	struct timespec ts = {0, SINK_POLL * 1e9};
+	uint64_t t_bin = lat_now();
+	size_t n, total;
+	int stop;
+	int k;
+
+	for (;;)
+	{
+		stop = atomic_load(&sink->stop);
+
+		// main owns the files and the plot while paused
+		if (atomic_load(&sink->pause) == 2)
+		{
+			nanosleep(&ts, NULL);
+			continue;
+		}
+
+		total = 0;
+		for (k = 0; k < sink->nrigs; k++)
+		{
+			n = ring_pop(&sink->rigs[k].ring, p, SINK_BATCH);
+			total += n;
+
+			// keep draining after an error so the producers never stall
+			if ((n > 0) && !atomic_load(&sink->error))
+				sink_batch(sink, &sink->rigs[k], p, n);
+
+			if (sink->rigs[k].uncommitted && !atomic_load(&sink->error) &&
+				(lat_now() - sink->rigs[k].t_commit > JOURNAL_PERIOD * 1e9))
+				rig_commit(&sink->rigs[k]);
+		}
+		if (total > 0)
+			continue;
+
+		if (stop)
+			break;
+		if (!atomic_load(&sink->error))
+		{
+			plot_flush(sink->plot);
+			if (lat_now() - t_bin > SINK_BIN_FLUSH * 1e9)
+			{
+				for (k = 0; k < sink->nrigs; k++)
+					if (sink->rigs[k].bin != NULL)
+						vacbin_flush(sink->rigs[k].bin);
+				t_bin = lat_now();
+			}
+		}
+		if (atomic_load(&sink->pause) == 1)
+		{
+			atomic_store(&sink->pause, 2);
+			continue;
+		}
+		nanosleep(&ts, NULL);
+	}
+
+	return NULL;
+}
+
+// the scanning channel sources the list, the other one holds its level
+// and measures on every source complete event of the scanning channel
+static void onboard_arm(struct instrument *ins)
+{
+	const char *smu   = (arg.Chan == 1) ? "smua" : "smub";
+	const char *other = (arg.Chan == 1) ? "smub" : "smua";
+
+	ins_printf(ins, "format.data = format.ASCII\n");
+	ins_printf(ins,
+		"%s.trigger.source.action = %s.ENABLE "
+		"%s.trigger.measure.iv(%s.nvbuffer1, %s.nvbuffer2) "
+		"%s.trigger.measure.action = %s.ENABLE "
+		"%s.trigger.endpulse.action = %s.SOURCE_HOLD "
+		"%s.trigger.endsweep.action = %s.SOURCE_HOLD "
+		"%s.trigger.arm.count = 1 "
+		"%s.measure.delay = %le\n",
+		smu, smu, smu, smu, smu, smu, smu, smu, smu, smu, smu, smu, smu, arg.Delay);
+	ins_printf(ins,
+		"%s.trigger.source.action = %s.DISABLE "
+		"%s.trigger.measure.iv(%s.nvbuffer1, %s.nvbuffer2) "
+		"%s.trigger.measure.action = %s.ENABLE "
+		"%s.trigger.measure.stimulus = %s.trigger.SOURCE_COMPLETE_EVENT_ID "
+		"%s.trigger.arm.count = 1 "
+		"%s.measure.delay = %le\n",
+		other, other, other, other, other, other, other, other, smu, other, other, arg.Delay);
+}
+
+static void onboard_disarm(struct instrument *ins)
+{
+	const char *smu   = (arg.Chan == 1) ? "smua" : "smub";
+	const char *other = (arg.Chan == 1) ? "smub" : "smua";
+
+	// the measure delay of the profile, the next recipe entry may skip the init block
+	ins_printf(ins,
+		"%s.trigger.measure.stimulus = 0 "
+		"%s.measure.delay = %s.%s "
+		"%s.measure.delay = %s.%s\n",
+		other, smu, smu, arg.Profile->delay, other, other, arg.Profile->delay);
+}
+
+// run the stages of the plan from its point <k> on as trigger model list
+// sweeps, <reversed> if stage 2 was retraced already
+static int sweep_onboard(struct rig *rig, struct instrument *ins, struct plan *plan, int k, int reversed, double V_start, double V_stop, double V_step, int *vac_index)
+{
+	enum meas_state state;
+	double voltage = 0.0;
+	int first, n;
+	int r = 0;
+
+	onboard_arm(ins);
+
+	// skipped stages are empty
+	for (state = M_STAGE1; (state <= M_STAGE3) && get_run(); state++)
+	{
+		first = (plan->first[state] > k) ? plan->first[state] : k;
+		n = plan->first[state + 1] - first;
+		if (n < 0)
+			n = 0;
+
+		if ((arg.Ramp > 0) && (state != M_STAGE2))
+			r = ramp_segment(rig, ins, state, &plan->pt[first], n, vac_index, &voltage);
+		else
+			r = onboard_segment(rig, ins, state, &plan->pt[first], n, vac_index, &voltage);
+		if (r < 0)
+			break;
+
+		// r == 2 is compliance, stage 2 is run again back to V_start once
+		if ((r == 2) && (state == M_STAGE2) && (arg.Compliance == COMPLY_REVERSE) && !reversed)
+		{
+			r = plan_reverse(rig, plan, voltage, &V_start, &V_stop, V_step);
+			if (r < 0)
+				break;
+			if (r == 0)
+			{
+				reversed = 1;
+				k = 0;
+				state--;
+				continue;
+			}
+			r = 2;
+		}
+
+		// r == 1 means the segment was aborted by "next stage" command,
+		// the following stages start from the voltage reached, or one
+		// step back from the compliance voltage
+		if ((r != 0) && (state < M_STAGE3))
+		{
+			r = plan_next(rig, plan, state, voltage, &V_start, &V_stop, (r == 2) ? -V_step : V_step);
+			if (r < 0)
+				break;
+			k = 0;
+		}
+	}
+
+	onboard_disarm(ins);
+
+	return (r < 0) ? r : 0;
+}
+
+// run one list sweep and read the buffers in chunks while it is running
+// returns 0 when the list is done, 1 if aborted by "next stage", 2 if
+// ended by compliance at <voltage> and negative value on error
+static int onboard_segment(struct rig *rig, struct instrument *ins, int stage, const struct plan_point *list, int n, int *vac_index, double *voltage)
+{
+	char buf[ONBOARD_CHUNK * 5 * 20 + 100];
+
+	const char *smu   = (arg.Chan == 1) ? "smua" : "smub";
+	const char *other = (arg.Chan == 1) ? "smub" : "smua";
+	double seg_time;
+	double t0 = 0.0;
+	double v[5];
+	struct point pt;
+	double count_s, count_o;
+	int count;
+	int done = 0;
+	int aborted = 0;
+	int comply = 0;
+	double V_comply = 0.0;
+	int i, j, k;
+	uint64_t t_ph;
+	char *c, *end;
+	int r;
+
+	if (n == 0)
+		return 0;
+
+	// upload setpoint list
+	ins_printf(ins, "fet4p_list = {}\n");
+	for (i = 0; i < n; i += ONBOARD_LIST)
+	{
+		c = buf;
+		for (j = i; (j < n) && (j < i + ONBOARD_LIST); j++)
+			c += sprintf(c, "fet4p_list[%d] = %lf ", j + 1, list[j].voltage);
+		ins_printf(ins, "%s\n", buf);
+	}
+
+	ins_printf(ins,
+		"%s.trigger.source.listv(fet4p_list) "
+		"%s.trigger.count = %d "
+		"%s.trigger.count = %d "
+		"%s.nvbuffer1.clear() %s.nvbuffer2.clear() "
+		"%s.nvbuffer1.clear() %s.nvbuffer2.clear() "
+		"%s.nvbuffer2.collecttimestamps = 1 "
+		"%s.trigger.initiate() "
+		"%s.trigger.initiate()\n",
+		smu, smu, n, other, n, smu, smu, other, other, smu, other, smu);
+
+	seg_time = get_time(rig);
+	if (seg_time < 0)
+	{
+		fprintf(stderr, "# E: Unable to get time\n");
+		return -1;
+	}
+
+	while (done < n)
+	{
+		if (!aborted && (!get_run() || get_next(rig) || take_converged(rig, stage)))
+		{
+			ins_printf(ins, "%s.abort() %s.abort()\n", smu, other);
+			aborted = 1;
+		}
+		else if (!aborted)
+			wait_delay(rig, ONBOARD_POLL);
+
+		r = ins_query(ins, buf, sizeof(buf), "print(smua.nvbuffer1.n, smub.nvbuffer1.n)\n");
+		if (r < 0)
+		{
+			fprintf(stderr, "# E: Unable to read from device (%s)\n", strerror(-r));
+			return -2;
+		}
+		// TSP prints numbers in exponential format
+		if (sscanf(buf, "%lf %lf", &count_s, &count_o) != 2)
+		{
+			fprintf(stderr, "# E: Unable to parse device response (%s)\n", buf);
+			return -3;
+		}
+		count = (count_s < count_o) ? count_s : count_o;
+
+		while (done < count)
+		{
+			k = ((count - done) < ONBOARD_CHUNK) ? (count - done) : ONBOARD_CHUNK;
+			t_ph = lat_now();
+
+			// only the buffer of the scanning channel collects timestamps
+			r = ins_query(ins, buf, sizeof(buf),
+				"printbuffer(%d, %d, "
+				"%s.nvbuffer2.timestamps, "
+				"smua.nvbuffer2.readings, smua.nvbuffer1.readings, "
+				"smub.nvbuffer2.readings, smub.nvbuffer1.readings)\n",
+				done + 1, done + k, smu);
+			phase_mark(rig, PH_READ, &t_ph);
+			if (r < 0)
+			{
+				fprintf(stderr, "# E: Unable to read from device (%s)\n", strerror(-r));
+				return -2;
+			}
+
+			c = buf;
+			for (i = 0; i < k; i++)
+			{
+				for (j = 0; j < 5; j++)
+				{
+					v[j] = strtod(c, &end);
+					if (end == c)
+					{
+						fprintf(stderr, "# E: Unable to parse device response (%s)\n", buf);
+						return -3;
+					}
+					c = end;
+					while ((*c == ',') || (*c == ' ') || (*c == '\t'))
+						c++;
+				}
+
+				if (done + i == 0)
+					t0 = v[0];
+
+				pt.index  = *vac_index;
+				pt.stage  = stage;
+				pt.time   = seg_time + v[0] - t0;
+				pt.V1 = v[1]; pt.I1 = v[2];
+				pt.V2 = v[3]; pt.I2 = v[4];
+				pt.settle = arg.Delay;
+				pt.I1_std = pt.I2_std = NAN;
+				pt.samples = 1;
+				*voltage = list[done + i].voltage;
+
+				// the segment is aborted on the next poll as by "next stage"
+				if (comply_point(&pt) && (arg.Compliance != COMPLY_OFF) && !comply)
+				{
+					fprintf(stderr, "# W: Compliance at %lf V in stage %d\n", *voltage, stage);
+					V_comply = *voltage;
+					comply   = 1;
+					if (!aborted)
+						set_next(rig, 1);
+				}
+
+				fprintf(stderr, "voltage = %lf\n", *voltage);
+				telemetry_setpoint(&telemetry, rig->id, stage, *voltage);
+
+				r = output_point(rig, &pt);
+				if (r < 0)
+					return -4;
+				timing_point(rig, *vac_index);
+				(*vac_index)++;
+			}
+
+			done += k;
+		}
+
+		if (aborted)
+			break;
+	}
+
+	if (aborted || comply)
+		set_next(rig, 0);
+
+	if (comply)
+	{
+		*voltage = V_comply;
+		return 2;
+	}
+	return aborted;
+}
+
+// step the scanning channel through the list at the --ramp slew rate,
+// only every --ramp_read-th point is read back and recorded
+// returns 0 when the list is done, 1 if aborted by "next stage" and
+// negative value on error
+static int ramp_segment(struct rig *rig, struct instrument *ins, int stage, const struct plan_point *list, int n, int *vac_index, double *voltage)
+{
+	double vac_time, dt;
+	struct point pt;
+	uint64_t t_ph;
+	int i, r;
+
+	for (i = 0; i < n; i++)
+	{
+		if (!get_run() || get_next(rig))
+		{
+			set_next(rig, 0);
+			return 1;
+		}
+
+		t_ph = lat_now();
+		dt = fabs(list[i].voltage - *voltage) / arg.Ramp;
+		*voltage = list[i].voltage;
+
+		if (arg.Chan == 1)
+			ins_printf(ins, "smua.source.levelv = %lf\n", *voltage);
+		else
+			ins_printf(ins, "smub.source.levelv = %lf\n", *voltage);
+		telemetry_setpoint(&telemetry, rig->id, stage, *voltage);
+		phase_mark(rig, PH_LEVEL, &t_ph);
+
+		// an interrupted wait is handled on the next point
+		wait_delay(rig, dt);
+		phase_mark(rig, PH_SETTLE, &t_ph);
+
+		if ((arg.Ramp_read == 0) || ((i + 1) % arg.Ramp_read != 0))
+			continue;
+
+		fprintf(stderr, "voltage = %lf\n", *voltage);
+
+		vac_time = get_time(rig);
+		if (vac_time < 0)
+		{
+			fprintf(stderr, "# E: Unable to get time\n");
+			return -1;
+		}
+
+		r = sample_point(rig, ins, 1, NAN, &pt);
+		if (r < 0)
+			return -2;
+		phase_mark(rig, PH_READ, &t_ph);
+
+		pt.index  = *vac_index;
+		pt.stage  = stage;
+		pt.time   = vac_time;
+		pt.settle = dt;
+		comply_point(&pt);
+		r = output_point(rig, &pt);
+		if (r < 0)
+			return -4;
+		timing_point(rig, *vac_index);
+		(*vac_index)++;
+	}
+
+	return 0;
+}
+
+// both channels hold their start levels and measure back to back until
+// aborted, the buffers keep the last STRESS_RING readings and start again
+// at index 1 once full
+static void stress_arm(struct instrument *ins)
+{
+	const char *smu[2] = {"smua", "smub"};
+	int k;
+
+	ins_printf(ins, "format.data = format.ASCII\n");
+	ins_printf(ins, "smua.source.levelv = %lf smub.source.levelv = %lf\n", arg.V1_start, arg.V2_start);
+	for (k = 0; k < 2; k++)
+		ins_printf(ins,
+			"%s.trigger.source.action = %s.DISABLE "
+			"%s.trigger.measure.iv(%s.nvbuffer1, %s.nvbuffer2) "
+			"%s.trigger.measure.action = %s.ENABLE "
+			"%s.trigger.measure.stimulus = 0 "
+			"%s.trigger.arm.count = 1 "
+			"%s.trigger.count = 0 "
+			"%s.nvbuffer1.fillmode = %s.FILL_WINDOW %s.nvbuffer1.fillcount = %d "
+			"%s.nvbuffer2.fillmode = %s.FILL_WINDOW %s.nvbuffer2.fillcount = %d "
+			"%s.nvbuffer2.collecttimestamps = 1 "
+			"%s.measure.delay = %le\n",
+			smu[k], smu[k], smu[k], smu[k], smu[k], smu[k], smu[k], smu[k], smu[k], smu[k],
+			smu[k], smu[k], smu[k], STRESS_RING, smu[k], smu[k], smu[k], STRESS_RING,
+			smu[k], smu[k], arg.Stress_interval);
+}
+
+static void stress_disarm(struct instrument *ins)
+{
+	ins_printf(ins,
+		"smua.measure.delay = smua.%s "
+		"smub.measure.delay = smub.%s "
+		"smua.nvbuffer1.fillmode = smua.FILL_ONCE smua.nvbuffer2.fillmode = smua.FILL_ONCE "
+		"smub.nvbuffer1.fillmode = smub.FILL_ONCE smub.nvbuffer2.fillmode = smub.FILL_ONCE\n",
+		arg.Profile->delay, arg.Profile->delay);
+}
+
+// hold the stress bias for --stress seconds, every --stress_sweep seconds
+// it is interrupted by a stage 2 sweep run on the instrument
+static int stress_run(struct rig *rig, struct instrument *ins, double V_start, double V_stop, double V_step, int *vac_index)
+{
+	struct plan plan = {0};
+	double voltage = 0.0;
+	double t_end, t_stop;
+	int r;
+
+	t_end = get_time(rig) + arg.Stress;
+	if (t_end < 0)
+	{
+		fprintf(stderr, "# E: Unable to get time\n");
+		return -1;
+	}
+
+	r = plan_build(&plan, M_STAGE2, V_start, V_stop, V_step);
+	if (r < 0)
+	{
+		fprintf(stderr, "# E: Unable to compile sweep plan (%s)\n", strerror(-r));
+		return r;
+	}
+
+	while (get_run())
+	{
+		t_stop = t_end;
+		if (arg.Stress_sweep > 0)
+			t_stop = fmin(t_end, get_time(rig) + arg.Stress_sweep);
+
+		telemetry_setpoint(&telemetry, rig->id, STRESS_STAGE, V_start);
+		stress_arm(ins);
+		r = stress_segment(rig, ins, t_stop, vac_index);
+		stress_disarm(ins);
+		if ((r != 0) || (t_stop >= t_end))
+			break;
+
+		// "next stage" during the sweep only ends the sweep
+		onboard_arm(ins);
+		r = onboard_segment(rig, ins, M_STAGE2, &plan.pt[plan.first[M_STAGE2]],
+			plan.first[M_STAGE3] - plan.first[M_STAGE2], vac_index, &voltage);
+		onboard_disarm(ins);
+		if (r < 0)
+			break;
+	}
+
+	plan_free(&plan);
+	return (r < 0) ? r : 0;
+}
+
+// read the stress readings in chunks by buffer index while one acquisition
+// runs until t_stop, the time comes from the instrument timestamps
+// returns 0 at t_stop, 1 if ended by "quit" or "next stage" and negative
+// value on error
+static int stress_segment(struct rig *rig, struct instrument *ins, double t_stop, int *vac_index)
+{
+	char buf[STRESS_CHUNK * 6 * 20 + 100];
+
+	double seg_time;
+	double t0 = 0.0;
+	double last_a = -1.0, last_b = -1.0;
+	double dt, t;
+	double v[6];
+	struct point pt;
+	double count_a, count_b;
+	long done = 0;
+	long lost;
+	int filled, slot, fresh;
+	int aborted = 0;
+	int stopped = 0;
+	int i, j, k;
+	uint64_t t_ph;
+	char *c, *end;
+	int r;
+
+	ins_printf(ins,
+		"smua.nvbuffer1.clear() smua.nvbuffer2.clear() "
+		"smub.nvbuffer1.clear() smub.nvbuffer2.clear() "
+		"smua.trigger.initiate() smub.trigger.initiate()\n");
+	seg_time = get_time(rig);
+
+	for (;;)
+	{
+		t = get_time(rig);
+		if ((seg_time < 0) || (t < 0))
+		{
+			fprintf(stderr, "# E: Unable to get time\n");
+			return -1;
+		}
+
+		if (!aborted && (!get_run() || get_next(rig) || (t >= t_stop)))
+		{
+			ins_printf(ins, "smua.abort() smub.abort()\n");
+			aborted = 1;
+			stopped = (t < t_stop);
+		}
+		else if (!aborted)
+			wait_delay(rig, fmin(STRESS_POLL, t_stop - t));
+
+		r = ins_query(ins, buf, sizeof(buf), "print(smua.nvbuffer1.n, smub.nvbuffer1.n)\n");
+		if (r < 0)
+		{
+			fprintf(stderr, "# E: Unable to read from device (%s)\n", strerror(-r));
+			return -2;
+		}
+		// TSP prints numbers in exponential format
+		if (sscanf(buf, "%lf %lf", &count_a, &count_b) != 2)
+		{
+			fprintf(stderr, "# E: Unable to parse device response (%s)\n", buf);
+			return -3;
+		}
+		filled = (count_a < count_b) ? count_a : count_b;
+
+		// reading <done> sits at index done % STRESS_RING + 1, once the
+		// window is full the indices are reused and the timestamps tell
+		// the new readings from the ones already taken
+		for (fresh = 1; fresh; )
+		{
+			slot = done % STRESS_RING + 1;
+			if (slot > filled)
+				break;
+			k = ((filled - slot + 1) < STRESS_CHUNK) ? (filled - slot + 1) : STRESS_CHUNK;
+			t_ph = lat_now();
+
+			r = ins_query(ins, buf, sizeof(buf),
+				"printbuffer(%d, %d, "
+				"smua.nvbuffer2.timestamps, "
+				"smua.nvbuffer2.readings, smua.nvbuffer1.readings, "
+				"smub.nvbuffer2.timestamps, "
+				"smub.nvbuffer2.readings, smub.nvbuffer1.readings)\n",
+				slot, slot + k - 1);
+			phase_mark(rig, PH_READ, &t_ph);
+			if (r < 0)
+			{
+				fprintf(stderr, "# E: Unable to read from device (%s)\n", strerror(-r));
+				return -2;
+			}
+
+			c = buf;
+			for (i = 0; i < k; i++)
+			{
+				for (j = 0; j < 6; j++)
+				{
+					v[j] = strtod(c, &end);
+					if (end == c)
+					{
+						fprintf(stderr, "# E: Unable to parse device response (%s)\n", buf);
+						return -3;
+					}
+					c = end;
+					while ((*c == ',') || (*c == ' ') || (*c == '\t'))
+						c++;
+				}
+
+				// not measured yet on this pass of the window
+				if ((v[0] <= last_a) || (v[3] <= last_b))
+				{
+					fresh = 0;
+					break;
+				}
+
+				// the host fell whole windows behind, the overwritten
+				// readings are skipped in the index column
+				if (done > 1)
+				{
+					dt = (last_a - t0) / (done - 1);
+					if (v[0] - last_a > dt * STRESS_RING / 2)
+					{
+						lost = STRESS_RING * lround((v[0] - last_a) / (dt * STRESS_RING));
+						fprintf(stderr, "# W: %s: %ld stress readings overwritten before they were read (%lf - %lf s)\n",
+							rig->dev, lost, seg_time + last_a - t0, seg_time + v[0] - t0);
+						done       += lost;
+						*vac_index += lost;
+					}
+				}
+
+				if (done == 0)
+					t0 = v[0];
+				last_a = v[0];
+				last_b = v[3];
+
+				pt.index  = *vac_index;
+				pt.stage  = STRESS_STAGE;
+				pt.time   = seg_time + v[0] - t0;
+				pt.V1 = v[1]; pt.I1 = v[2];
+				pt.V2 = v[4]; pt.I2 = v[5];
+				pt.settle = arg.Stress_interval;
+				pt.I1_std = pt.I2_std = NAN;
+				pt.samples = 1;
+				comply_point(&pt);
+
+				r = output_point(rig, &pt);
+				if (r < 0)
+					return -4;
+				timing_point(rig, *vac_index);
+				(*vac_index)++;
+				done++;
+			}
+		}
+
+		if (aborted)
+			break;
+	}
+
+	if (stopped)
+		set_next(rig, 0);
+	return stopped;
+}
+
+// === stage 2 analysis
+static void analyze_open(struct rig *rig)
+{
+	struct analyze_config cfg;
+
+	cfg.chan     = arg.Chan;
+	cfg.window   = arg.Fit_window;
+	cfg.mu_k     = arg.Mu_k;
+	cfg.stop_tol = arg.Early_stop;
+	analyze_init(&rig->analyze, &cfg);
+}
+
+static void analyze_summary(struct rig *rig)
+{
+	char filename[250];
+	FILE *fp;
+
+	snprintf(filename, 250, "%s/analysis.dat", rig->dir);
+	fp = fopen(filename, "w");
+	if (fp == NULL)
+	{
+		fprintf(stderr, "# E: Unable to open file \"%s\" (%s)\n", filename, strerror(errno));
+		return;
+	}
+
+	analyze_print(fp, &rig->analyze);
+	fclose(fp);
+}
+
+// === per-point phase timing
+static void phase_mark(struct rig *rig, int ph, uint64_t *t)
+{
+	uint64_t now = lat_now();
+
+	if (ph < PH_WORKER)
+		rig->phase_ns[ph] = now - *t;
+	lat_record(&rig->phase_hist[ph], now - *t);
+	*t = now;
+}
+
+static int timing_open(struct rig *rig)
+{
+	char filename[250];
+	int k;
+
+	for (k = 0; k < PH_COUNT; k++)
+		lat_reset(&rig->phase_hist[k]);
+	memset(rig->phase_ns, 0, sizeof(rig->phase_ns));
+
+	rig->timing_fp = NULL;
+	if (!arg.Timings)
+		return 0;
+
+	// a resumed run adds its points to the file
+	snprintf(filename, 250, "%s/timing.dat", rig->dir);
+	rig->timing_fp = fopen(filename, (arg.Resume != NULL) ? "a" : "w");
+	if (rig->timing_fp == NULL)
+	{
+		fprintf(stderr, "# E: Unable to open file \"%s\" (%s)\n", filename, strerror(errno));
+		return -1;
+	}
+	if (arg.Resume != NULL)
+		return 0;
+
+	fprintf(rig->timing_fp, "# Per-point phase timings, ms\n");
+	fprintf(rig->timing_fp, "# 1: index\n");
+	for (k = 0; k < PH_WORKER; k++)
+		fprintf(rig->timing_fp, "# %d: %s\n", k + 2, phase_name[k]);
+
+	return 0;
+}
+
+static void timing_point(struct rig *rig, int vac_index)
+{
+	int k;
+
+	if (rig->timing_fp != NULL)
+	{
+		fprintf(rig->timing_fp, "%d", vac_index);
+		for (k = 0; k < PH_WORKER; k++)
+			fprintf(rig->timing_fp, "\t%.3lf", rig->phase_ns[k] / 1e6);
+		fprintf(rig->timing_fp, "\n");
+	}
+
+	memset(rig->phase_ns, 0, sizeof(rig->phase_ns));
+}
+
+static void timing_summary(struct rig *rig)
+{
+	struct ring *ring = &rig->ring;
+	char filename[250];
+	FILE *fp;
+	int k;
+
+	if (rig->timing_fp != NULL)
+	{
+		fclose(rig->timing_fp);
+		rig->timing_fp = NULL;
+	}
+
+	snprintf(filename, 250, "%s/latency.txt", rig->dir);
+	fp = fopen(filename, "w");
+	if (fp == NULL)
+	{
+		fprintf(stderr, "# E: Unable to open file \"%s\" (%s)\n", filename, strerror(errno));
+		return;
+	}
+
+	fprintf(fp, "# Per-point phase latency summary\n");
+	lat_print_header(fp);
+	for (k = 0; k < PH_COUNT; k++)
+		if (rig->phase_hist[k].count > 0)
+			lat_print(fp, phase_name[k], &rig->phase_hist[k]);
+
+	fprintf(fp, "# Output ring: %" PRIuFAST64 " pushed, %" PRIuFAST64 " stalls, %" PRIuFAST64 " dropped, %zu of %zu max fill\n",
+		atomic_load(&ring->pushed),
+		atomic_load(&ring->stalls),
+		atomic_load(&ring->dropped),
+		atomic_load(&ring->high),
+		ring->mask + 1
+	);
+	if (atomic_load(&ring->dropped) > 0)
+		fprintf(stderr, "# E: %s: %" PRIuFAST64 " points dropped by output ring\n", rig->sample_name, atomic_load(&ring->dropped));
+	if (arg.Period > 0)
+		fprintf(fp, "# Pace: period %.3lf ms, %" PRIu64 " missed slots\n", arg.Period * 1e3, rig->overruns);
+
+	fclose(fp);
 }
@@ -0,0 +1,95 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+
+#include "plan.h"
+
+#define PLAN_EPS 1e-9 // relative end point tolerance
+
+int plan_count(double from, double to, double unit)
+{
+	double d = fabs(to - from) / unit;
+
+	if (d < PLAN_EPS)
+		return 0;
+	return (int) ceil(d - PLAN_EPS);
+}
+
+int plan_build(struct plan *p, int stage, double V_start, double V_stop, double unit)
+{
+	double from[PLAN_STAGES + 1] = {0.0, 0.0,     V_start, V_stop};
+	double to[PLAN_STAGES + 1]   = {0.0, V_start, V_stop,  0.0};
+	struct plan_point *pt;
+	int n, s, k, dir;
+
+	n = 0;
+	for (s = stage; s <= PLAN_STAGES; s++)
+		n += plan_count(from[s], to[s], unit);
+
+	if (n > p->cap)
+	{
+		pt = realloc(p->pt, n * sizeof(struct plan_point));
+		if (pt == NULL)
+			return -ENOMEM;
+		p->pt  = pt;
+		p->cap = n;
+	}
+
+	p->n = 0;
+	p->unit = unit;
+	for (s = 0; s < stage; s++)
+		p->first[s] = 0;
+	for (s = stage; s <= PLAN_STAGES; s++)
+	{
+		p->first[s] = p->n;
+		dir = (to[s] >= from[s]) ? 1 : -1;
+		n = plan_count(from[s], to[s], unit);
+		for (k = 0; k < n; k++)
+		{
+			p->pt[p->n].stage   = s;
+			p->pt[p->n].voltage = from[s] + k * unit * dir;
+			p->n++;
+		}
+	}
+	p->first[PLAN_STAGES + 1] = p->n;
+
+	return 0;
+}
+
+void plan_free(struct plan *p)
+{
+	free(p->pt);
+	memset(p, 0, sizeof(struct plan));
+}
+
+int plan_advance(const struct plan *p, int k, int inc)
+{
+	int next;
+
+	if ((k < 0) || (k >= p->n))
+		return p->n;
+
+	next = p->first[p->pt[k].stage + 1];
+	return (k + inc < next) ? k + inc : next;
+}
+
+double plan_vmax(const struct plan *p)
+{
+	double v = 0.0;
+	int k;
+
+	for (k = 0; k < p->n; k++)
+		if (fabs(p->pt[k].voltage) > v)
+			v = fabs(p->pt[k].voltage);
+	return v;
+}
+
+void plan_print(FILE *fp, const struct plan *p)
+{
+	int k;
+
+	for (k = 0; k < p->n; k++)
+		fprintf(fp, "%d\t%d\t%+lf\n", k, p->pt[k].stage, p->pt[k].voltage);
+}
@@ -0,0 +1,46 @@
+#ifndef PLAN_H
+#define PLAN_H
+
+#include <stdio.h>
+
+// === [PLAN] ===
+#define PLAN_STAGES 3 // 0 -> V_start, V_start -> V_stop, V_stop -> 0
+
+// one setpoint of the scanning channel
+struct plan_point
+{
+	int    stage; // 1 - 3
+	double voltage;
+};
+
+// the sweep compiled into a point list, stage s covers the points
+// first[s] .. first[s + 1] - 1, every stage excludes its end point
+// because the next stage starts there
+struct plan
+{
+	struct plan_point *pt;
+	int    n;
+	int    cap;
+	int    first[PLAN_STAGES + 2];
+	double unit;
+};
+
+// points of one stage, k * unit < |to - from| with a relative tolerance
+// so a float rounded end point is neither dropped nor duplicated
+int  plan_count(double from, double to, double unit);
+
+// compile stages <stage> .. 3 into p, the previous content is replaced
+int  plan_build(struct plan *p, int stage, double V_start, double V_stop, double unit);
+void plan_free(struct plan *p);
+
+// point after k for a step of inc points, a step never crosses a stage end,
+// it goes to the first point of the next stage instead
+int  plan_advance(const struct plan *p, int k, int inc);
+
+// largest |voltage| of the plan
+double plan_vmax(const struct plan *p);
+
+// "index stage voltage" rows
+void plan_print(FILE *fp, const struct plan *p);
+
+#endif
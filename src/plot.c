@@ -0,0 +1,263 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+
+#include "plot.h"
+#include "latency.h"
+
+static int plot_append(struct plot *p, const char *fmt, ...)
+	__attribute__ ((format (printf, 2, 3)));
+
+static int plot_append(struct plot *p, const char *fmt, ...)
+{
+	va_list ap;
+	char *s;
+	int n;
+
+	for (;;)
+	{
+		va_start(ap, fmt);
+		n = vsnprintf(p->pending + p->len, p->cap - p->len, fmt, ap);
+		va_end(ap);
+		if (n < 0)
+			return -EINVAL;
+		if (p->len + n < p->cap)
+			break;
+
+		s = realloc(p->pending, 2 * p->cap + n);
+		if (s == NULL)
+			return -ENOMEM;
+		p->pending = s;
+		p->cap = 2 * p->cap + n;
+	}
+	p->len += n;
+
+	return 0;
+}
+
+// axis and empty datablocks of a new run
+static int plot_axes(struct plot *p, double xmin, double xmax)
+{
+	int k, r;
+
+	r = fprintf(p->gp, "set xlabel \"%s\"\n", (p->xcol == 2) ? "t, s" : "Vg, V");
+	if (r >= 0)
+		r = isinf(xmax) ? fprintf(p->gp, "set xrange [%le:*]\n", xmin) :
+			fprintf(p->gp, "set xrange [%le:%le]\n", xmin, xmax);
+	for (k = 0; (k < p->ntraces) && (r >= 0); k++)
+		r = fprintf(p->gp, "$vac%d << EOD\nEOD\n", k);
+	if (r >= 0)
+		r = fprintf(p->gp, "set print $vac0 append\n");
+	if ((r < 0) || (fflush(p->gp) == EOF))
+		return -EIO;
+
+	return 0;
+}
+
+int plot_open(struct plot *p, const char *dir, double fps, int xcol, double xmin, double xmax,
+	int ntraces, const char *const *names)
+{
+	char buf[300];
+	int k, r;
+
+	memset(p, 0, sizeof(struct plot));
+	p->fps  = fps;
+	p->xcol = xcol;
+
+	if (fps <= 0)
+		return 0;
+
+	p->trace = calloc(ntraces, sizeof(struct plot_trace));
+	if (p->trace == NULL)
+		return -ENOMEM;
+	p->ntraces = ntraces;
+	for (k = 0; k < ntraces; k++)
+		p->trace[k].name = names[k];
+
+	p->cap = 4096;
+	p->pending = malloc(p->cap);
+	if (p->pending == NULL)
+	{
+		free(p->trace);
+		return -ENOMEM;
+	}
+
+	snprintf(buf, 300, "gnuplot > %s/gnuplot.log 2>&1", dir);
+	p->gp = popen(buf, "w");
+	if (p->gp == NULL)
+	{
+		r = -errno;
+		free(p->pending);
+		free(p->trace);
+		return r;
+	}
+
+	r = fprintf(p->gp,
+		"set term qt noraise\n"
+		"set xzeroaxis lt -1\n"
+		"set yzeroaxis lt -1\n"
+		"set grid\n"
+		"set key right bottom\n"
+		"set ylabel \"Id, A\"\n"
+		"set format y \"%%.3s%%c\"\n"
+	);
+	r = (r < 0) ? -EIO : plot_axes(p, xmin, xmax);
+	if (r < 0)
+	{
+		pclose(p->gp);
+		free(p->pending);
+		free(p->trace);
+		p->gp      = NULL;
+		p->pending = NULL;
+		p->trace   = NULL;
+	}
+
+	return r;
+}
+
+int plot_reset(struct plot *p, int xcol, double xmin, double xmax, const char *const *names)
+{
+	int k;
+
+	p->xcol = xcol;
+	if (p->gp == NULL)
+		return 0;
+
+	p->len     = 0;
+	p->npoints = 0;
+	p->dirty   = 0;
+	p->current = 0;
+	p->index   = 0;
+	p->time    = 0.0;
+	for (k = 0; k < p->ntraces; k++)
+	{
+		memset(&p->trace[k], 0, sizeof(struct plot_trace));
+		p->trace[k].name = names[k];
+	}
+
+	if (fprintf(p->gp, "unset print\n") < 0)
+		return -EIO;
+	return plot_axes(p, xmin, xmax);
+}
+
+int plot_point(struct plot *p, int trace, int index, double time, double V1, double I1, double V2, double I2)
+{
+	struct plot_trace *t;
+	uint64_t now;
+	int r;
+
+	if (p->gp == NULL)
+		return 0;
+
+	if (trace != p->current)
+	{
+		r = plot_append(p, "set print $vac%d append\n", trace);
+		if (r < 0)
+			return r;
+		p->current = trace;
+	}
+
+	r = plot_append(p, "print \"%d %le %le %le %le %le\"\n", index, time, V1, I1, V2, I2);
+	if (r < 0)
+		return r;
+
+	p->npoints++;
+	p->dirty = 1;
+	p->index = index;
+	p->time  = time;
+
+	t = &p->trace[trace];
+	t->V1 = V1; t->I1 = I1;
+	t->V2 = V2; t->I2 = I2;
+
+	now = lat_now();
+	if ((now - p->last_frame) < 1e9 / p->fps)
+		return 0;
+
+	return plot_flush(p);
+}
+
+// title line of a trace, shown on the next redraw
+int plot_note(struct plot *p, int trace, const char *note)
+{
+	if (p->gp == NULL)
+		return 0;
+
+	snprintf(p->trace[trace].note, PLOT_NOTE, "%s", note);
+	p->dirty = 1;
+	return 0;
+}
+
+// send pending points and redraw
+int plot_flush(struct plot *p)
+{
+	struct plot_trace *t;
+	int k, r;
+
+	if ((p->gp == NULL) || !p->dirty)
+		return 0;
+
+	r = plot_append(p, "set title \"i = %d, t = %.3lf s", p->index, p->time);
+	if (r < 0)
+		return r;
+	for (k = 0; k < p->ntraces; k++)
+	{
+		t = &p->trace[k];
+		if (t->note[0] == '\0')
+			continue;
+		r = plot_append(p, "\\n%s%s%s", (p->ntraces > 1) ? t->name : "", (p->ntraces > 1) ? ": " : "", t->note);
+		if (r < 0)
+			return r;
+	}
+	r = plot_append(p, "\"\nplot ");
+	if (r < 0)
+		return r;
+
+	// a single rig keeps the plain key
+	for (k = 0; k < p->ntraces; k++)
+	{
+		t = &p->trace[k];
+		r = plot_append(p,
+			"%s$vac%d u %d:4 w l lw 1 title \"%s%sV1 = %.3lf V, I1 = %le A\", "
+			  "$vac%d u %d:6 w l lw 1 title \"%s%sV2 = %.3lf V, I2 = %le A\"",
+			(k > 0) ? ", " : "",
+			k, p->xcol, (p->ntraces > 1) ? t->name : "", (p->ntraces > 1) ? ": " : "", t->V1, t->I1,
+			k, p->xcol, (p->ntraces > 1) ? t->name : "", (p->ntraces > 1) ? ": " : "", t->V2, t->I2
+		);
+		if (r < 0)
+			return r;
+	}
+	r = plot_append(p, "\n");
+	if (r < 0)
+		return r;
+
+	if (fwrite(p->pending, 1, p->len, p->gp) != p->len)
+		return -EIO;
+	if (fflush(p->gp) == EOF)
+		return -errno;
+
+	p->len = 0;
+	p->dirty = 0;
+	p->last_frame = lat_now();
+
+	return 0;
+}
+
+void plot_close(struct plot *p)
+{
+	if (p->gp != NULL)
+	{
+		plot_flush(p);
+		fprintf(p->gp, "exit;\n");
+		if (pclose(p->gp) == -1)
+			fprintf(stderr, "# E: Unable to close gnuplot pipe (%s)\n", strerror(errno));
+	}
+	free(p->pending);
+	free(p->trace);
+	p->gp = NULL;
+	p->pending = NULL;
+	p->trace = NULL;
+}
@@ -0,0 +1,58 @@
+#ifndef PLOT_H
+#define PLOT_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+
+// === [PLOT] ===
+#define PLOT_FPS  5.0 // default maximum redraw rate, frames/s
+#define PLOT_NOTE 160 // title line per rig, bytes
+
+// last point of one rig for the key
+struct plot_trace
+{
+	const char *name;
+	double      V1, I1, V2, I2;
+	char        note[PLOT_NOTE]; // added to the title when not empty
+};
+
+// live gnuplot view of the vac points of one or more rigs
+// new points are appended to the $vac<trace> datablocks and the plot is
+// redrawn from memory at most <fps> times per second
+struct plot
+{
+	FILE    *gp;
+	double   fps;
+	int      xcol;
+	uint64_t last_frame;
+
+	// commands not sent to gnuplot yet
+	char    *pending;
+	size_t   len;
+	size_t   cap;
+	int      npoints;
+	int      dirty;
+	int      current; // datablock "set print" appends to
+
+	// last point for the title
+	int      index;
+	double   time;
+
+	struct plot_trace *trace;
+	int      ntraces;
+};
+
+// headless mode (gp == NULL) when fps is zero, one trace per name
+// xcol is the vac column on the x axis, 2 - time, an infinite xmax autoscales
+int  plot_open(struct plot *p, const char *dir, double fps, int xcol, double xmin, double xmax,
+	int ntraces, const char *const *names);
+// clear the traces for a new run in the same window, the pending points
+// have been flushed
+int  plot_reset(struct plot *p, int xcol, double xmin, double xmax, const char *const *names);
+int  plot_point(struct plot *p, int trace, int index, double time, double V1, double I1, double V2, double I2);
+int  plot_note(struct plot *p, int trace, const char *note);
+int  plot_flush(struct plot *p);
+void plot_close(struct plot *p);
+
+#endif
@@ -0,0 +1,21 @@
+#ifndef POINT_H
+#define POINT_H
+
+// one measured point as it travels from the acquisition thread to the outputs
+struct point
+{
+	int    index;
+	int    stage;  // 1 - 3 sweep stages, 0 - bias stress
+	double time;
+	double V1;
+	double I1;
+	double V2;
+	double I2;
+	double settle; // time from setting the level to the reading, s
+	double I1_std; // standard deviation of the readings, NAN for one reading
+	double I2_std;
+	int    samples; // readings averaged into V1, I1, V2, I2
+	int    compliance; // bit 0 - I1, bit 1 - I2 at the current limit
+};
+
+#endif
@@ -0,0 +1,93 @@
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "ring.h"
+
+int ring_init(struct ring *r, size_t size)
+{
+	memset(r, 0, sizeof(struct ring));
+
+	if ((size == 0) || (size & (size - 1)))
+		return -1;
+
+	r->buf = malloc(size * sizeof(struct point));
+	if (r->buf == NULL)
+		return -1;
+	r->mask = size - 1;
+
+	atomic_init(&r->head, 0);
+	atomic_init(&r->tail, 0);
+	atomic_init(&r->pushed, 0);
+	atomic_init(&r->stalls, 0);
+	atomic_init(&r->dropped, 0);
+	atomic_init(&r->high, 0);
+
+	return 0;
+}
+
+void ring_free(struct ring *r)
+{
+	free(r->buf);
+	r->buf = NULL;
+}
+
+void ring_reset(struct ring *r)
+{
+	atomic_store(&r->pushed, 0);
+	atomic_store(&r->stalls, 0);
+	atomic_store(&r->dropped, 0);
+	atomic_store(&r->high, 0);
+}
+
+int ring_push(struct ring *r, const struct point *p)
+{
+	size_t head = atomic_load_explicit(&r->head, memory_order_relaxed);
+	size_t tail = atomic_load_explicit(&r->tail, memory_order_acquire);
+	struct timespec ts = {0, 100000};
+	long waited = 0;
+
+	if (head - tail > r->mask)
+	{
+		atomic_fetch_add_explicit(&r->stalls, 1, memory_order_relaxed);
+		do
+		{
+			if (waited >= RING_TIMEOUT * 1e9)
+			{
+				atomic_fetch_add_explicit(&r->dropped, 1, memory_order_relaxed);
+				return -1;
+			}
+			nanosleep(&ts, NULL);
+			waited += ts.tv_nsec;
+			tail = atomic_load_explicit(&r->tail, memory_order_acquire);
+		}
+		while (head - tail > r->mask);
+	}
+
+	r->buf[head & r->mask] = *p;
+	atomic_store_explicit(&r->head, head + 1, memory_order_release);
+
+	atomic_fetch_add_explicit(&r->pushed, 1, memory_order_relaxed);
+	if (head + 1 - tail > atomic_load_explicit(&r->high, memory_order_relaxed))
+		atomic_store_explicit(&r->high, head + 1 - tail, memory_order_relaxed);
+
+	return 0;
+}
+
+size_t ring_pop(struct ring *r, struct point *p, size_t max)
+{
+	size_t tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+	size_t head = atomic_load_explicit(&r->head, memory_order_acquire);
+	size_t n = head - tail;
+	size_t k;
+
+	if (n > max)
+		n = max;
+
+	for (k = 0; k < n; k++)
+		p[k] = r->buf[(tail + k) & r->mask];
+
+	atomic_store_explicit(&r->tail, tail + n, memory_order_release);
+
+	return n;
+}
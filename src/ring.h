@@ -0,0 +1,43 @@
+#ifndef RING_H
+#define RING_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdatomic.h>
+
+#include "point.h"
+
+// === [RING] ===
+#define RING_SIZE    4096 // points, power of two
+#define RING_TIMEOUT 1.0  // producer back-pressure limit, s
+
+// single-producer/single-consumer lock-free ring of point records
+// the producer waits up to RING_TIMEOUT for free space and drops the point
+// after that, both events are counted
+struct ring
+{
+	struct point *buf;
+	size_t mask;
+
+	_Alignas(64) atomic_size_t head; // written by producer only
+	_Alignas(64) atomic_size_t tail; // written by consumer only
+
+	_Alignas(64) atomic_uint_fast64_t pushed;
+	atomic_uint_fast64_t stalls;
+	atomic_uint_fast64_t dropped;
+	atomic_size_t        high;       // fill level high-water mark
+};
+
+int    ring_init(struct ring *r, size_t size);
+void   ring_free(struct ring *r);
+
+// zero the counters for a new run, the ring is empty and both sides idle
+void   ring_reset(struct ring *r);
+
+// producer side, returns -1 if the point was dropped
+int    ring_push(struct ring *r, const struct point *p);
+
+// consumer side, copies up to max points and returns their number
+size_t ring_pop(struct ring *r, struct point *p, size_t max);
+
+#endif
@@ -0,0 +1,1026 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <math.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "sim.h"
+
+// === [MODEL] ===
+// EKV-like FET: smua drives the gate, smub drives the drain
+#define SIM_VTH      1.0    // threshold voltage, V
+#define SIM_NUT      0.0375 // slope factor times thermal voltage, V
+#define SIM_ISPEC    1.9e-7 // specific current, A
+#define SIM_R_GATE   1e10   // gate leakage resistance, Ohm
+#define SIM_R_OFF    1e11   // drain off resistance, Ohm
+#define SIM_I_FLOOR  1e-12  // absolute current noise, A
+#define SIM_LINE     50.0   // power line frequency, Hz
+
+#define SIM_VARS     64
+#define SIM_TABLES   64
+#define SIM_LINE_MAX 65536
+#define SIM_VALS     8
+
+struct sim_table
+{
+	double *v;
+	int     n;
+	int     cap;
+	int     refs; // variables and trigger lists holding it
+	int     used;
+};
+
+struct sim_buf
+{
+	double *i;
+	double *v;
+	double *t;
+	int     n;
+	int     cap;
+	int     window; // FILL_WINDOW, readings restart at 1 after fillcount
+	int     fill;   // fillcount, 0 is unbounded
+	long    total;  // readings since the last clear()
+};
+
+struct sim_smu
+{
+	int    output;
+	double levelv;
+	double limiti;
+	double delay;
+	double nplc;
+	int    filter;       // repeat average enabled
+	int    filter_count;
+
+	int    compliance;
+
+	int    trig_count;
+	int    trig_src;
+	int    trig_meas;
+	int    stamps;       // the buffer collects timestamps
+	int    trig_running;
+	int    trig_done;
+	double trig_start;
+	struct sim_table *trig_list;
+
+	struct sim_buf buf;
+};
+
+enum value_type
+{
+	V_NIL = 0,
+	V_NUM,
+	V_BOOL,
+	V_TAB,
+	V_BUF
+};
+
+struct value
+{
+	enum value_type type;
+	double num;
+	struct sim_table *tab;
+	int    smu;
+	int    field; // 0 - currents, 1 - voltages, 2 - timestamps
+};
+
+struct sim_var
+{
+	char name[64];
+	struct value val;
+};
+
+struct sim
+{
+	struct sim_config cfg;
+	int   fd;
+	FILE *in;
+	FILE *out;
+
+	struct sim_smu smu[2];
+
+	struct sim_var vars[SIM_VARS];
+	int    nvars;
+
+	struct sim_table *tables[SIM_TABLES];
+	int    ntables;
+
+	double   t0;
+	uint64_t rng;
+
+	// currents relax towards the steady state after every level change
+	double settle_t;
+	double settle_from[2];
+
+	// parser state
+	const char *p;
+	int    error;
+};
+
+static void *sim_thread(void *a);
+
+// === utils
+static double sim_now(struct sim *s)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9 - s->t0;
+}
+
+static double sim_gauss(struct sim *s)
+{
+	double u1, u2;
+
+	// xorshift64*
+	s->rng ^= s->rng >> 12;
+	s->rng ^= s->rng << 25;
+	s->rng ^= s->rng >> 27;
+	u1 = ((s->rng * 2685821657736338717ULL) >> 11) * (1.0 / 9007199254740992.0);
+	s->rng ^= s->rng >> 12;
+	s->rng ^= s->rng << 25;
+	s->rng ^= s->rng >> 27;
+	u2 = ((s->rng * 2685821657736338717ULL) >> 11) * (1.0 / 9007199254740992.0);
+
+	if (u1 < 1e-300)
+		u1 = 1e-300;
+	return sqrt(-2.0 * log(u1)) * cos(2.0 * M_PI * u2);
+}
+
+static void sim_sleep(double t)
+{
+	if (t > 0)
+		usleep(t * 1e6);
+}
+
+// === device model
+static double ekv_f(double x)
+{
+	double l = (x > 0) ? x / 2 + log1p(exp(-x / 2)) : log1p(exp(x / 2));
+	return l * l;
+}
+
+// noise free steady state current
+static double sim_steady(struct sim *s, int smu)
+{
+	double Vg = s->smu[0].output ? s->smu[0].levelv : 0.0;
+	double Vd = s->smu[1].output ? s->smu[1].levelv : 0.0;
+
+	if (!s->smu[smu].output)
+		return 0.0;
+
+	if (smu == 0)
+		return Vg / SIM_R_GATE;
+
+	return SIM_ISPEC * (ekv_f((Vg - SIM_VTH) / SIM_NUT) - ekv_f((Vg - SIM_VTH - Vd) / SIM_NUT))
+		+ Vd / SIM_R_OFF;
+}
+
+// noise free current at time t
+static double sim_transient(struct sim *s, int smu, double t)
+{
+	double I = sim_steady(s, smu);
+
+	if (s->cfg.tau > 0)
+		I += (s->settle_from[smu] - I) * exp(-fmax(t - s->settle_t, 0.0) / s->cfg.tau);
+
+	return I;
+}
+
+// call before changing a level or an output state at time t
+static void sim_settle_mark(struct sim *s, double t)
+{
+	int k;
+
+	for (k = 0; k < 2; k++)
+		s->settle_from[k] = sim_transient(s, k, t);
+	s->settle_t = t;
+}
+
+// power line cycles integrated per reading
+static double sim_average(struct sim_smu *m)
+{
+	return m->nplc * (m->filter ? m->filter_count : 1);
+}
+
+static double sim_current(struct sim *s, int smu, double t)
+{
+	struct sim_smu *m = &s->smu[smu];
+	double I;
+
+	if (!m->output)
+		return SIM_I_FLOOR * sim_gauss(s);
+
+	// noise is given for one reading at 1 NPLC and averages down
+	I  = sim_transient(s, smu, t);
+	I += fabs(I) * s->cfg.noise / sqrt(fmax(sim_average(m), 0.001)) * sim_gauss(s) + SIM_I_FLOOR * sim_gauss(s);
+
+	m->compliance = (fabs(I) >= m->limiti);
+	if (m->compliance)
+		I = (I > 0) ? m->limiti : -m->limiti;
+
+	return I;
+}
+
+static double sim_voltage(struct sim *s, int smu)
+{
+	struct sim_smu *m = &s->smu[smu];
+
+	if (!m->output)
+		return 0.0;
+	return m->levelv + 1e-6 * sim_gauss(s);
+}
+
+static double sim_meas_time(struct sim_smu *m)
+{
+	return sim_average(m) / SIM_LINE;
+}
+
+// trigger model: source-measure period and next reading time of running sweep
+static double trig_period(struct sim_smu *m)
+{
+	double delay = (m->delay > 0) ? m->delay : 0.0;
+	return delay + sim_meas_time(m);
+}
+
+static double trig_next(struct sim_smu *m)
+{
+	return m->trig_start + (m->trig_done + 1) * trig_period(m);
+}
+
+// apply list levels of all sourcing sweeps at time t, step k covers
+// the interval (k * period, (k + 1) * period]
+static void trig_source(struct sim *s, double t)
+{
+	struct sim_smu *m;
+	double level;
+	int k, i;
+
+	for (k = 0; k < 2; k++)
+	{
+		m = &s->smu[k];
+		if (!m->trig_running || !m->trig_src || (m->trig_list == NULL) || (m->trig_list->n == 0))
+			continue;
+
+		i = (int) ceil((t - m->trig_start) / trig_period(m) - 1e-9) - 1;
+		if (i < 0)
+			i = 0;
+		if ((m->trig_count > 0) && (i >= m->trig_count))
+			i = m->trig_count - 1;
+		level = m->trig_list->v[i % m->trig_list->n];
+		if (level != m->levelv)
+		{
+			sim_settle_mark(s, m->trig_start + i * trig_period(m));
+			m->levelv = level;
+		}
+	}
+}
+
+static void buf_append(struct sim_buf *b, double i, double v, double t)
+{
+	int k;
+
+	if (b->window && (b->fill > 0) && (b->n == b->fill))
+	{
+		k = b->total % b->fill;
+		b->i[k] = i;
+		b->v[k] = v;
+		b->t[k] = t;
+		b->total++;
+		return;
+	}
+	if (b->n == b->cap)
+	{
+		b->cap = b->cap ? b->cap * 2 : 256;
+		b->i = realloc(b->i, b->cap * sizeof(double));
+		b->v = realloc(b->v, b->cap * sizeof(double));
+		b->t = realloc(b->t, b->cap * sizeof(double));
+	}
+	b->i[b->n] = i;
+	b->v[b->n] = v;
+	b->t[b->n] = t;
+	b->n++;
+	b->total++;
+}
+
+// generate all trigger model readings due up to now in time order
+static void sim_update(struct sim *s)
+{
+	double now = sim_now(s);
+	struct sim_smu *m;
+	double t, tn;
+	int k, n;
+
+	for (;;)
+	{
+		n = -1;
+		t = now;
+		for (k = 0; k < 2; k++)
+		{
+			m = &s->smu[k];
+			if (!m->trig_running)
+				continue;
+			tn = trig_next(m);
+			if (tn <= t)
+			{
+				t = tn;
+				n = k;
+			}
+		}
+		if (n < 0)
+			break;
+
+		m = &s->smu[n];
+		trig_source(s, t);
+		if (m->trig_meas)
+			buf_append(&m->buf, sim_current(s, n, t), sim_voltage(s, n), t - m->trig_start);
+
+		m->trig_done++;
+		if ((m->trig_count > 0) && (m->trig_done >= m->trig_count))
+			m->trig_running = 0;
+	}
+}
+
+// === variables and tables
+static struct sim_table *table_new(struct sim *s)
+{
+	struct sim_table *t;
+	int k;
+
+	for (k = 0; k < s->ntables; k++)
+		if (!s->tables[k]->used)
+			break;
+
+	if (k < s->ntables)
+		t = s->tables[k];
+	else if (s->ntables == SIM_TABLES)
+		return NULL;
+	else
+	{
+		t = calloc(1, sizeof(struct sim_table));
+		if (t == NULL)
+			return NULL;
+		s->tables[s->ntables++] = t;
+	}
+
+	t->n    = 0;
+	t->used = 1;
+	return t;
+}
+
+static void table_ref(struct value v, int d)
+{
+	if ((v.type == V_TAB) && (v.tab != NULL))
+		v.tab->refs += d;
+}
+
+// a table nothing holds once a line is done is free for the next
+// constructor, the temporaries of a line live until its end
+static void table_sweep(struct sim *s)
+{
+	int k;
+
+	for (k = 0; k < s->ntables; k++)
+		if (s->tables[k]->refs == 0)
+			s->tables[k]->used = 0;
+}
+
+static void table_set(struct sim_table *t, int idx, double v)
+{
+	if (idx < 1)
+		return;
+	while (idx > t->cap)
+	{
+		t->cap = t->cap ? t->cap * 2 : 64;
+		t->v = realloc(t->v, t->cap * sizeof(double));
+	}
+	while (t->n < idx)
+		t->v[t->n++] = 0.0;
+	t->v[idx - 1] = v;
+}
+
+static struct sim_var *var_get(struct sim *s, const char *name, int create)
+{
+	int k;
+
+	for (k = 0; k < s->nvars; k++)
+		if (strcmp(s->vars[k].name, name) == 0)
+			return &s->vars[k];
+
+	if (!create || (s->nvars == SIM_VARS))
+		return NULL;
+
+	snprintf(s->vars[s->nvars].name, sizeof(s->vars[0].name), "%s", name);
+	s->vars[s->nvars].val.type = V_NIL;
+	return &s->vars[s->nvars++];
+}
+
+// split "smua.source.levelv" into smu index and "source.levelv"
+static const char *smu_member(const char *name, int *smu)
+{
+	if ((strncmp(name, "smua.", 5) == 0) || (strncmp(name, "smub.", 5) == 0))
+	{
+		*smu = name[3] - 'a';
+		return name + 5;
+	}
+	return NULL;
+}
+
+static int is_constant(const char *name)
+{
+	const char *c = strrchr(name, '.');
+	c = c ? c + 1 : name;
+	for (; *c; c++)
+		if (islower((unsigned char) *c))
+			return 0;
+	return 1;
+}
+
+static struct value num(double v)
+{
+	struct value r = {0};
+	r.type = V_NUM;
+	r.num  = v;
+	return r;
+}
+
+static double to_num(struct value v)
+{
+	return (v.type == V_NUM || v.type == V_BOOL) ? v.num : 0.0;
+}
+
+static struct value constant(const char *name)
+{
+	static const struct { const char *name; double v; } c[] =
+	{
+		{"OUTPUT_OFF"              , 0}, {"OUTPUT_ON"     , 1},
+		{"OUTPUT_DCAMPS"           , 0}, {"OUTPUT_DCVOLTS", 1},
+		{"AUTORANGE_OFF"           , 0}, {"AUTORANGE_ON"  , 1},
+		{"DISABLE"                 , 0}, {"ENABLE"        , 1},
+		{"SOURCE_IDLE"             , 0}, {"SOURCE_HOLD"   , 1},
+		{"DELAY_OFF"               , 0}, {"DELAY_AUTO"    , -1},
+		{"SOURCE_COMPLETE_EVENT_ID", 1}, {"ASCII"         , 1},
+		{"FILTER_OFF"              , 0}, {"FILTER_ON"     , 1},
+		{"FILL_ONCE"               , 0}, {"FILL_WINDOW"   , 1},
+	};
+	const char *n = strrchr(name, '.');
+	unsigned k;
+
+	n = n ? n + 1 : name;
+	for (k = 0; k < sizeof(c) / sizeof(c[0]); k++)
+		if (strcmp(c[k].name, n) == 0)
+			return num(c[k].v);
+	return num(0);
+}
+
+static struct value name_get(struct sim *s, const char *name)
+{
+	struct value r = {0};
+	struct sim_var *v;
+	struct sim_smu *m;
+	const char *f;
+	int smu;
+
+	if (is_constant(name))
+		return constant(name);
+
+	f = smu_member(name, &smu);
+	if (f == NULL)
+	{
+		v = var_get(s, name, 0);
+		return v ? v->val : r;
+	}
+
+	m = &s->smu[smu];
+	if (strcmp(f, "source.levelv") == 0)     return num(m->levelv);
+	if (strcmp(f, "source.limiti") == 0)     return num(m->limiti);
+	if (strcmp(f, "source.output") == 0)     return num(m->output);
+	if (strcmp(f, "measure.nplc") == 0)      return num(m->nplc);
+	if (strcmp(f, "measure.filter.enable") == 0) return num(m->filter);
+	if (strcmp(f, "measure.filter.count") == 0)  return num(m->filter_count);
+	if (strcmp(f, "measure.delay") == 0)     return num(m->delay);
+	if (strcmp(f, "trigger.count") == 0)     return num(m->trig_count);
+	if (strcmp(f, "source.compliance") == 0)
+	{
+		r.type = V_BOOL;
+		r.num  = m->compliance;
+		return r;
+	}
+	if ((strncmp(f, "nvbuffer", 8) == 0) && (f[8] == '1' || f[8] == '2'))
+	{
+		if (strcmp(f + 9, ".n") == 0)
+			return num(m->buf.n);
+
+		r.type  = V_BUF;
+		r.smu   = smu;
+		r.field = (strcmp(f + 9, ".timestamps") == 0) ? 2 : f[8] - '1';
+		return r;
+	}
+
+	return r;
+}
+
+static void name_set(struct sim *s, const char *name, struct value val)
+{
+	struct sim_var *v;
+	struct sim_smu *m;
+	const char *f;
+	int smu;
+	double x = to_num(val);
+
+	f = smu_member(name, &smu);
+	if (f == NULL)
+	{
+		if (strncmp(name, "format.", 7) == 0)
+			return;
+		v = var_get(s, name, 1);
+		if (v != NULL)
+		{
+			table_ref(val, 1);
+			table_ref(v->val, -1);
+			v->val = val;
+		}
+		return;
+	}
+
+	m = &s->smu[smu];
+	if ((strcmp(f, "source.levelv") == 0) || (strcmp(f, "source.output") == 0))
+		sim_settle_mark(s, sim_now(s));
+
+	if      (strcmp(f, "source.levelv") == 0)          m->levelv     = x;
+	else if (strcmp(f, "source.limiti") == 0)          m->limiti     = x;
+	else if (strcmp(f, "source.output") == 0)          m->output     = (x != 0);
+	else if (strcmp(f, "measure.nplc") == 0)           m->nplc       = x;
+	else if (strcmp(f, "measure.filter.enable") == 0)  m->filter     = (x != 0);
+	else if (strcmp(f, "measure.filter.count") == 0)   m->filter_count = x;
+	else if (strcmp(f, "measure.delay") == 0)          m->delay      = x;
+	else if (strcmp(f, "trigger.count") == 0)          m->trig_count = x;
+	else if (strcmp(f, "trigger.source.action") == 0)  m->trig_src   = (x != 0);
+	else if (strcmp(f, "trigger.measure.action") == 0) m->trig_meas  = (x != 0);
+	else if ((strcmp(f, "nvbuffer1.collecttimestamps") == 0) ||
+		(strcmp(f, "nvbuffer2.collecttimestamps") == 0))   m->stamps     = (x != 0);
+	else if ((strcmp(f, "nvbuffer1.fillmode") == 0) ||
+		(strcmp(f, "nvbuffer2.fillmode") == 0))            m->buf.window = (x != 0);
+	else if ((strcmp(f, "nvbuffer1.fillcount") == 0) ||
+		(strcmp(f, "nvbuffer2.fillcount") == 0))           m->buf.fill   = x;
+	// everything else is accepted and ignored
+}
+
+// === builtin functions
+static void print_value(struct sim *s, struct value v)
+{
+	switch (v.type)
+	{
+		case V_NUM:  fprintf(s->out, "%.5e", v.num);                  break;
+		case V_BOOL: fprintf(s->out, "%s", v.num ? "true" : "false"); break;
+		case V_TAB:  fprintf(s->out, "table: %p", (void *) v.tab);    break;
+		case V_BUF:  fprintf(s->out, "buffer");                       break;
+		default:     fprintf(s->out, "nil");                          break;
+	}
+}
+
+static void do_print(struct sim *s, struct value *args, int n)
+{
+	int k;
+
+	sim_sleep(s->cfg.latency);
+	for (k = 0; k < n; k++)
+	{
+		if (k > 0)
+			fputc('\t', s->out);
+		print_value(s, args[k]);
+	}
+	fputc('\n', s->out);
+	fflush(s->out);
+}
+
+static void do_printbuffer(struct sim *s, struct value *args, int n)
+{
+	struct sim_buf *b;
+	double v;
+	int from, to, i, k;
+	int first = 1;
+
+	sim_sleep(s->cfg.latency);
+	if (n >= 3)
+	{
+		from = to_num(args[0]);
+		to   = to_num(args[1]);
+		for (i = from; i <= to; i++)
+			for (k = 2; k < n; k++)
+			{
+				if (args[k].type != V_BUF)
+					continue;
+				b = &s->smu[args[k].smu].buf;
+				if ((i < 1) || (i > b->n))
+					continue;
+				// like the instrument, no timestamps unless the buffer collects them
+				if ((args[k].field == 2) && !s->smu[args[k].smu].stamps)
+				{
+					fprintf(s->out, first ? "nil" : ", nil");
+					first = 0;
+					continue;
+				}
+				v = (args[k].field == 0) ? b->i[i - 1] : (args[k].field == 1) ? b->v[i - 1] : b->t[i - 1];
+				fprintf(s->out, first ? "%.5e" : ", %.5e", v);
+				first = 0;
+			}
+	}
+	fputc('\n', s->out);
+	fflush(s->out);
+}
+
+static int call(struct sim *s, const char *name, struct value *args, int n, struct value *ret)
+{
+	struct sim_smu *m;
+	const char *f;
+	int smu;
+
+	if (strcmp(name, "print") == 0)
+	{
+		do_print(s, args, n);
+		return 0;
+	}
+	if (strcmp(name, "printbuffer") == 0)
+	{
+		do_printbuffer(s, args, n);
+		return 0;
+	}
+
+	f = smu_member(name, &smu);
+	if (f == NULL)
+		return 0;
+	m = &s->smu[smu];
+
+	if (strcmp(f, "measure.v") == 0)
+	{
+		sim_sleep(sim_meas_time(m));
+		ret[0] = num(sim_voltage(s, smu));
+		return 1;
+	}
+	if (strcmp(f, "measure.i") == 0)
+	{
+		sim_sleep(sim_meas_time(m));
+		ret[0] = num(sim_current(s, smu, sim_now(s)));
+		return 1;
+	}
+	if (strcmp(f, "measure.iv") == 0)
+	{
+		sim_sleep(sim_meas_time(m));
+		ret[0] = num(sim_current(s, smu, sim_now(s)));
+		ret[1] = num(sim_voltage(s, smu));
+		return 2;
+	}
+	if (strcmp(f, "trigger.source.listv") == 0)
+	{
+		if ((n > 0) && (args[0].type == V_TAB))
+		{
+			args[0].tab->refs++;
+			if (m->trig_list != NULL)
+				m->trig_list->refs--;
+			m->trig_list = args[0].tab;
+		}
+		return 0;
+	}
+	if (strcmp(f, "trigger.initiate") == 0)
+	{
+		m->trig_running = 1;
+		m->trig_done    = 0;
+		m->trig_start   = sim_now(s);
+		return 0;
+	}
+	if (strcmp(f, "abort") == 0)
+	{
+		m->trig_running = 0;
+		return 0;
+	}
+	if ((strcmp(f, "nvbuffer1.clear") == 0) || (strcmp(f, "nvbuffer2.clear") == 0))
+	{
+		m->buf.n = 0;
+		m->buf.total = 0;
+		return 0;
+	}
+
+	return 0;
+}
+
+// === TSP subset parser
+static void skip_space(struct sim *s)
+{
+	for (;;)
+	{
+		while (isspace((unsigned char) *s->p))
+			s->p++;
+		if ((s->p[0] == '-') && (s->p[1] == '-'))
+			s->p += strlen(s->p);
+		else
+			break;
+	}
+}
+
+static int accept(struct sim *s, char c)
+{
+	skip_space(s);
+	if (*s->p == c)
+	{
+		s->p++;
+		return 1;
+	}
+	return 0;
+}
+
+static int parse_name(struct sim *s, char *name, size_t len)
+{
+	size_t n = 0;
+
+	skip_space(s);
+	if (!(isalpha((unsigned char) *s->p) || (*s->p == '_')))
+		return 0;
+	while (isalnum((unsigned char) *s->p) || (*s->p == '_') || (*s->p == '.'))
+	{
+		if (n + 1 < len)
+			name[n++] = *s->p;
+		s->p++;
+	}
+	name[n] = '\0';
+	return 1;
+}
+
+static int parse_exprlist(struct sim *s, struct value *vals, int max, char close);
+
+// parse one expression, calls may return several values
+static int parse_expr(struct sim *s, struct value *vals, int max)
+{
+	char name[128];
+	struct value args[SIM_VALS];
+	struct sim_table *t;
+	const char *save;
+	char *end;
+	double x;
+	int n, k;
+
+	skip_space(s);
+
+	if (accept(s, '-'))
+	{
+		n = parse_expr(s, vals, max);
+		if (n > 0)
+			vals[0] = num(-to_num(vals[0]));
+		return n;
+	}
+
+	if (accept(s, '{'))
+	{
+		t = table_new(s);
+		n = parse_exprlist(s, args, SIM_VALS, '}');
+		if ((t == NULL) || (n < 0))
+		{
+			s->error = 1;
+			return 0;
+		}
+		for (k = 0; k < n; k++)
+			table_set(t, k + 1, to_num(args[k]));
+		vals[0].type = V_TAB;
+		vals[0].tab  = t;
+		return 1;
+	}
+
+	x = strtod(s->p, &end);
+	if (end != s->p)
+	{
+		s->p = end;
+		vals[0] = num(x);
+		return 1;
+	}
+
+	if (strncmp(s->p, "true", 4) == 0 || strncmp(s->p, "false", 5) == 0)
+	{
+		vals[0].type = V_BOOL;
+		vals[0].num  = (s->p[0] == 't');
+		s->p += vals[0].num ? 4 : 5;
+		return 1;
+	}
+
+	save = s->p;
+	if (!parse_name(s, name, sizeof(name)))
+	{
+		s->p = save;
+		s->error = 1;
+		return 0;
+	}
+
+	if (accept(s, '('))
+	{
+		n = parse_exprlist(s, args, SIM_VALS, ')');
+		if (n < 0)
+			return 0;
+		sim_update(s);
+		memset(vals, 0, max * sizeof(struct value));
+		return call(s, name, args, n, vals);
+	}
+
+	sim_update(s);
+	vals[0] = name_get(s, name);
+	return 1;
+}
+
+// comma separated expressions up to <close>, the last one keeps all its values
+static int parse_exprlist(struct sim *s, struct value *vals, int max, char close)
+{
+	struct value v[SIM_VALS];
+	int n = 0;
+	int k, m;
+
+	if (accept(s, close))
+		return 0;
+
+	for (;;)
+	{
+		m = parse_expr(s, v, SIM_VALS);
+		if (s->error)
+			return -1;
+
+		if (accept(s, ','))
+		{
+			if (n < max)
+				vals[n++] = (m > 0) ? v[0] : (struct value) {0};
+			continue;
+		}
+
+		for (k = 0; (k < m) && (n < max); k++)
+			vals[n++] = v[k];
+
+		if ((close != 0) && !accept(s, close))
+		{
+			s->error = 1;
+			return -1;
+		}
+		return n;
+	}
+}
+
+static void parse_statement(struct sim *s)
+{
+	char names[SIM_VALS][128];
+	struct value vals[SIM_VALS];
+	struct value idx;
+	struct sim_var *var;
+	const char *save;
+	int nn = 0;
+	int n, k;
+
+	save = s->p;
+	if (parse_name(s, names[0], sizeof(names[0])) && (strcmp(names[0], "local") != 0))
+		s->p = save;
+
+	save = s->p;
+	if (!parse_name(s, names[0], sizeof(names[0])))
+	{
+		s->error = 1;
+		return;
+	}
+	nn = 1;
+
+	// function call statement
+	skip_space(s);
+	if (*s->p == '(')
+	{
+		s->p = save;
+		parse_expr(s, vals, SIM_VALS);
+		return;
+	}
+
+	// table element assignment
+	if (accept(s, '['))
+	{
+		if ((parse_expr(s, &idx, 1) < 1) || !accept(s, ']') || !accept(s, '='))
+		{
+			s->error = 1;
+			return;
+		}
+		if (parse_expr(s, vals, SIM_VALS) < 1)
+		{
+			s->error = 1;
+			return;
+		}
+		var = var_get(s, names[0], 0);
+		if ((var != NULL) && (var->val.type == V_TAB))
+			table_set(var->val.tab, to_num(idx), to_num(vals[0]));
+		return;
+	}
+
+	// plain assignment
+	while (accept(s, ','))
+	{
+		if ((nn == SIM_VALS) || !parse_name(s, names[nn], sizeof(names[0])))
+		{
+			s->error = 1;
+			return;
+		}
+		nn++;
+	}
+	if (!accept(s, '='))
+	{
+		s->error = 1;
+		return;
+	}
+
+	n = parse_exprlist(s, vals, SIM_VALS, 0);
+	if (n < 0)
+		return;
+	for (k = 0; k < nn; k++)
+		name_set(s, names[k], (k < n) ? vals[k] : (struct value) {0});
+}
+
+static void sim_execute(struct sim *s, const char *line)
+{
+	table_sweep(s);
+	s->p = line;
+	s->error = 0;
+
+	for (;;)
+	{
+		skip_space(s);
+		if (*s->p == '\0')
+			break;
+		parse_statement(s);
+		if (s->error)
+		{
+			fprintf(stderr, "# W: sim: unable to parse \"%s\"\n", s->p);
+			break;
+		}
+	}
+}
+
+// === thread
+int sim_start(int fd, const struct sim_config *cfg, pthread_t *thread)
+{
+	struct sim *s;
+	struct timespec ts;
+	int k;
+
+	s = calloc(1, sizeof(struct sim));
+	if (s == NULL)
+		return -1;
+
+	s->cfg = *cfg;
+	s->fd  = fd;
+	s->rng = 0x9E3779B97F4A7C15ULL;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	s->t0 = ts.tv_sec + ts.tv_nsec / 1e9;
+
+	for (k = 0; k < 2; k++)
+	{
+		s->smu[k].limiti = 0.1;
+		s->smu[k].delay  = -1;
+		s->smu[k].nplc   = 1.0;
+		s->smu[k].filter_count = 1;
+		s->smu[k].trig_count = 1;
+	}
+
+	if (pthread_create(thread, NULL, sim_thread, s) != 0)
+	{
+		free(s);
+		return -1;
+	}
+
+	return 0;
+}
+
+static void *sim_thread(void *a)
+{
+	struct sim *s = a;
+	char *line;
+	int k;
+
+	line = malloc(SIM_LINE_MAX);
+	s->in  = fdopen(s->fd, "r");
+	s->out = fdopen(dup(s->fd), "w");
+
+	if ((line != NULL) && (s->in != NULL) && (s->out != NULL))
+		while (fgets(line, SIM_LINE_MAX, s->in) != NULL)
+			sim_execute(s, line);
+
+	if (s->out) fclose(s->out);
+	if (s->in) fclose(s->in);
+	free(line);
+
+	for (k = 0; k < s->ntables; k++)
+	{
+		free(s->tables[k]->v);
+		free(s->tables[k]);
+	}
+	for (k = 0; k < 2; k++)
+	{
+		free(s->smu[k].buf.i);
+		free(s->smu[k].buf.v);
+		free(s->smu[k].buf.t);
+	}
+	free(s);
+
+	return NULL;
+}
@@ -0,0 +1,22 @@
+#ifndef SIM_H
+#define SIM_H
+
+#include <pthread.h>
+
+// === [SIMULATOR] ===
+#define SIM_LATENCY 0.001 // response latency, s
+#define SIM_NOISE   0.01  // relative current noise
+#define SIM_TAU     0.02  // current settling time constant, s
+
+struct sim_config
+{
+	double latency;
+	double noise;
+	double tau;
+};
+
+// serve a simulated 2600-series SMU with a FET between smua (gate)
+// and smub (drain) on the socket fd, the thread exits on EOF
+int sim_start(int fd, const struct sim_config *cfg, pthread_t *thread);
+
+#endif
@@ -0,0 +1,301 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "telemetry.h"
+
+// the readers are other processes, a lock would not be shared with them
+_Static_assert(ATOMIC_LLONG_LOCK_FREE == 2, "64 bit atomics are not lock-free");
+_Static_assert(sizeof(struct tlm_header) == 64, "telemetry header layout");
+_Static_assert(sizeof(struct tlm_state) == 128, "telemetry state layout");
+_Static_assert(sizeof(struct tlm_slot) == 88, "telemetry slot layout");
+_Static_assert(offsetof(struct tlm_rig, head) == 128, "telemetry rig layout");
+_Static_assert(offsetof(struct tlm_rig, slot) == 192, "telemetry rig layout");
+
+static struct tlm_rig *tlm_rig(const struct tlm_header *h, int rig)
+{
+	return (struct tlm_rig *) ((char *) h + h->header_size + (size_t) rig * h->rig_size);
+}
+
+// === seqlock, one writer per rig
+static void tlm_begin(_Atomic uint64_t *seq)
+{
+	atomic_store_explicit(seq, atomic_load_explicit(seq, memory_order_relaxed) + 1, memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+}
+
+static void tlm_end(_Atomic uint64_t *seq)
+{
+	atomic_store_explicit(seq, atomic_load_explicit(seq, memory_order_relaxed) + 1, memory_order_release);
+}
+
+// === writer
+int telemetry_create(struct telemetry *t, const char *name, int rigs)
+{
+	struct tlm_header *h;
+	size_t size;
+	int fd, r;
+
+	t->h = NULL;
+	snprintf(t->name, sizeof(t->name), TLM_PREFIX "%s", name);
+	size = sizeof(struct tlm_header) + rigs * sizeof(struct tlm_rig);
+
+	// the object of a killed run is replaced, its readers keep the old one
+	shm_unlink(t->name);
+	fd = shm_open(t->name, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+	if (fd < 0)
+		return -errno;
+
+	// the new object reads as zeros
+	if (ftruncate(fd, size) < 0)
+	{
+		r = -errno;
+		close(fd);
+		shm_unlink(t->name);
+		return r;
+	}
+
+	h = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (h == MAP_FAILED)
+	{
+		r = -errno;
+		shm_unlink(t->name);
+		return r;
+	}
+
+	h->version     = TLM_VERSION;
+	h->header_size = sizeof(struct tlm_header);
+	h->rig_size    = sizeof(struct tlm_rig);
+	h->slot_size   = sizeof(struct tlm_slot);
+	h->slots       = TLM_SLOTS;
+	h->rigs        = rigs;
+	h->pid         = getpid();
+
+	// a reader checks the magic before the rest of the header
+	atomic_thread_fence(memory_order_release);
+	memcpy(h->magic, TLM_MAGIC, 8);
+
+	t->h    = h;
+	t->size = size;
+	return 0;
+}
+
+// the readers still see the last points and the closed flag
+void telemetry_close(struct telemetry *t)
+{
+	if (t->h == NULL)
+		return;
+
+	atomic_store_explicit(&t->h->closed, 1, memory_order_release);
+	munmap(t->h, t->size);
+	shm_unlink(t->name);
+	t->h = NULL;
+}
+
+void telemetry_entry(struct telemetry *t, int rig, int chan, const char *sample_name)
+{
+	struct tlm_state *s;
+
+	if (t->h == NULL)
+		return;
+	s = &tlm_rig(t->h, rig)->state;
+
+	tlm_begin(&s->seq);
+	s->entry++;
+	s->running    = 1;
+	s->chan       = chan;
+	s->stage      = 0;
+	s->index      = -1;
+	s->compliance = 0;
+	s->setpoint   = 0.0;
+	s->time       = 0.0;
+	memset(s->sample_name, 0, TLM_NAME);
+	strncpy(s->sample_name, sample_name, TLM_NAME - 1);
+	tlm_end(&s->seq);
+}
+
+void telemetry_setpoint(struct telemetry *t, int rig, int stage, double setpoint)
+{
+	struct tlm_state *s;
+
+	if (t->h == NULL)
+		return;
+	s = &tlm_rig(t->h, rig)->state;
+
+	tlm_begin(&s->seq);
+	s->stage    = stage;
+	s->setpoint = setpoint;
+	tlm_end(&s->seq);
+}
+
+void telemetry_idle(struct telemetry *t, int rig)
+{
+	struct tlm_state *s;
+
+	if (t->h == NULL)
+		return;
+	s = &tlm_rig(t->h, rig)->state;
+
+	tlm_begin(&s->seq);
+	s->running = 0;
+	tlm_end(&s->seq);
+}
+
+void telemetry_point(struct telemetry *t, int rig, const struct point *p)
+{
+	struct tlm_rig *r;
+	struct tlm_slot *s;
+	uint64_t n;
+
+	if (t->h == NULL)
+		return;
+	r = tlm_rig(t->h, rig);
+
+	n = atomic_load_explicit(&r->head, memory_order_relaxed);
+	s = &r->slot[n & (TLM_SLOTS - 1)];
+
+	atomic_store_explicit(&s->seq, 2 * n + 1, memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+	s->index      = p->index;
+	s->stage      = p->stage;
+	s->time       = p->time;
+	s->V1         = p->V1;
+	s->I1         = p->I1;
+	s->V2         = p->V2;
+	s->I2         = p->I2;
+	s->settle     = p->settle;
+	s->I1_std     = p->I1_std;
+	s->I2_std     = p->I2_std;
+	s->samples    = p->samples;
+	s->compliance = p->compliance;
+	atomic_store_explicit(&s->seq, 2 * n + 2, memory_order_release);
+	atomic_store_explicit(&r->head, n + 1, memory_order_release);
+
+	tlm_begin(&r->state.seq);
+	r->state.stage      = p->stage;
+	r->state.index      = p->index;
+	r->state.compliance = p->compliance;
+	r->state.time       = p->time;
+	tlm_end(&r->state.seq);
+}
+
+// === reader
+int telemetry_map(struct telemetry_map *m, const char *name)
+{
+	const struct tlm_header *h;
+	char path[256];
+	struct stat st;
+	int fd, r;
+
+	memset(m, 0, sizeof(struct telemetry_map));
+
+	snprintf(path, sizeof(path), TLM_PREFIX "%s", name);
+	fd = shm_open(path, O_RDONLY | O_CLOEXEC, 0);
+	if (fd < 0)
+		return -errno;
+
+	if (fstat(fd, &st) < 0)
+	{
+		r = -errno;
+		close(fd);
+		return r;
+	}
+	// not sized by its writer yet
+	if ((size_t) st.st_size < sizeof(struct tlm_header))
+	{
+		close(fd);
+		return -EAGAIN;
+	}
+
+	m->size = st.st_size;
+	m->h = mmap(NULL, m->size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (m->h == MAP_FAILED)
+	{
+		m->h = NULL;
+		return -errno;
+	}
+
+	// a header without the magic is still being written
+	h = m->h;
+	r = 0;
+	if (memcmp(h->magic, TLM_MAGIC, 8) != 0)
+		r = -EAGAIN;
+	atomic_thread_fence(memory_order_acquire);
+	if ((r == 0) &&
+		((h->version != TLM_VERSION) || (h->header_size != sizeof(struct tlm_header)) ||
+		(h->rig_size != sizeof(struct tlm_rig)) || (h->slot_size != sizeof(struct tlm_slot)) ||
+		(h->slots != TLM_SLOTS) || (h->header_size + (size_t) h->rigs * h->rig_size > m->size)))
+		r = -EINVAL;
+	if (r < 0)
+		telemetry_unmap(m);
+	return r;
+}
+
+void telemetry_unmap(struct telemetry_map *m)
+{
+	if (m->h != NULL)
+		munmap((void *) m->h, m->size);
+	m->h = NULL;
+}
+
+uint64_t telemetry_head(const struct telemetry_map *m, int rig)
+{
+	return atomic_load_explicit(&tlm_rig(m->h, rig)->head, memory_order_acquire);
+}
+
+void telemetry_state(const struct telemetry_map *m, int rig, struct tlm_state *s)
+{
+	const struct tlm_state *src = &tlm_rig(m->h, rig)->state;
+	uint64_t s1, s2;
+
+	for (;;)
+	{
+		s1 = atomic_load_explicit(&src->seq, memory_order_acquire);
+		memcpy(s, src, sizeof(struct tlm_state));
+		atomic_thread_fence(memory_order_acquire);
+		s2 = atomic_load_explicit(&src->seq, memory_order_relaxed);
+		if (((s1 & 1) == 0) && (s1 == s2))
+			return;
+	}
+}
+
+int telemetry_get(const struct telemetry_map *m, int rig, uint64_t n, struct point *p)
+{
+	const struct tlm_slot *src = &tlm_rig(m->h, rig)->slot[n & (TLM_SLOTS - 1)];
+	struct tlm_slot s;
+	uint64_t s1, s2;
+
+	s1 = atomic_load_explicit(&src->seq, memory_order_acquire);
+	if (s1 < 2 * n + 2)
+		return 1;
+	if (s1 > 2 * n + 2)
+		return -1;
+
+	memcpy(&s, src, sizeof(struct tlm_slot));
+	atomic_thread_fence(memory_order_acquire);
+	s2 = atomic_load_explicit(&src->seq, memory_order_relaxed);
+	if (s2 != s1)
+		return -1;
+
+	p->index      = s.index;
+	p->stage      = s.stage;
+	p->time       = s.time;
+	p->V1         = s.V1;
+	p->I1         = s.I1;
+	p->V2         = s.V2;
+	p->I2         = s.I2;
+	p->settle     = s.settle;
+	p->I1_std     = s.I1_std;
+	p->I2_std     = s.I2_std;
+	p->samples    = s.samples;
+	p->compliance = s.compliance;
+	return 0;
+}
@@ -0,0 +1,152 @@
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdatomic.h>
+
+#include "point.h"
+
+// === [TELEMETRY] ===
+#define TLM_MAGIC   "FET4PTLM"
+#define TLM_VERSION 1
+#define TLM_SLOTS   4096 // points per rig, power of two
+#define TLM_PREFIX  "/fet4p." // shared memory object of --telemetry <name>
+#define TLM_NAME    64   // sample name bytes
+
+// POSIX shared memory object TLM_PREFIX<name>, host byte order, written by
+// one process, read by any number of others without locks:
+//   header, 64 bytes
+//   0    8  magic "FET4PTLM"
+//   8    4  u32 version
+//   12   4  u32 header_size, offset of the first rig block
+//   16   4  u32 rig_size, bytes per rig block
+//   20   4  u32 slot_size
+//   24   4  u32 slots per rig, power of two
+//   28   4  u32 rigs
+//   32   8  i64 pid of the writer
+//   40   8  u64 closed, 1 once the writer is done
+// rig block at header_size + rig * rig_size:
+//   0  128  run state
+//     0    8  u64 seq, odd while the state is written
+//     8    4  i32 entry, counts the recipe entries of the run from 1
+//     12   4  i32 running, 0 between the entries and after the run
+//     16   4  i32 Chan, scanning channel
+//     20   4  i32 stage, 1 - 3 sweep stages, 0 - bias stress
+//     24   4  i32 index of the last point
+//     28   4  i32 compliance of the last point
+//     32   8  f64 setpoint of the scanning channel, V
+//     40   8  f64 time of the last point, s
+//     48  64  sample name, NUL padded
+//   128   8  u64 head, points published
+//   192   .  slots, point n of the rig is in slot n % slots
+//     0    8  u64 seq, 2n + 1 while point n is written, 2n + 2 once done
+//     8    4  i32 index
+//     12   4  i32 stage
+//     16   8  f64 time, s
+//     24   8  f64 V1, V
+//     32   8  f64 I1, A
+//     40   8  f64 V2, V
+//     48   8  f64 I2, A
+//     56   8  f64 settle time, s
+//     64   8  f64 I1 standard deviation, A
+//     72   8  f64 I2 standard deviation, A
+//     80   4  i32 samples
+//     84   4  i32 compliance flags
+// a reader copies the state or a slot between two reads of its seq and
+// keeps the copy if both are the same even value (seqlock), a slot that
+// has moved on to a later point was overwritten before it was read
+struct tlm_header
+{
+	char     magic[8];
+	uint32_t version;
+	uint32_t header_size;
+	uint32_t rig_size;
+	uint32_t slot_size;
+	uint32_t slots;
+	uint32_t rigs;
+	int64_t  pid;
+	_Atomic uint64_t closed;
+	uint8_t  reserved[16];
+};
+
+struct tlm_state
+{
+	_Atomic uint64_t seq;
+	int32_t  entry;
+	int32_t  running;
+	int32_t  chan;
+	int32_t  stage;
+	int32_t  index;
+	int32_t  compliance;
+	double   setpoint;
+	double   time;
+	char     sample_name[TLM_NAME];
+	uint8_t  reserved[16];
+};
+
+struct tlm_slot
+{
+	_Atomic uint64_t seq;
+	int32_t  index;
+	int32_t  stage;
+	double   time;
+	double   V1;
+	double   I1;
+	double   V2;
+	double   I2;
+	double   settle;
+	double   I1_std;
+	double   I2_std;
+	int32_t  samples;
+	int32_t  compliance;
+};
+
+struct tlm_rig
+{
+	struct tlm_state state;
+	_Alignas(64) _Atomic uint64_t head;
+	_Alignas(64) struct tlm_slot slot[TLM_SLOTS];
+};
+
+// writer, the functions do nothing while it is not created
+struct telemetry
+{
+	struct tlm_header *h;
+	size_t size;
+	char   name[256];
+};
+
+int  telemetry_create(struct telemetry *t, const char *name, int rigs);
+void telemetry_close(struct telemetry *t);
+
+// run state of a rig: a new entry, the setpoint of the scanning channel
+// and the end of an entry
+void telemetry_entry(struct telemetry *t, int rig, int chan, const char *sample_name);
+void telemetry_setpoint(struct telemetry *t, int rig, int stage, double setpoint);
+void telemetry_idle(struct telemetry *t, int rig);
+
+// publish a point, it is the last point of the run state too
+void telemetry_point(struct telemetry *t, int rig, const struct point *p);
+
+// reader
+struct telemetry_map
+{
+	const struct tlm_header *h;
+	size_t size;
+};
+
+int  telemetry_map(struct telemetry_map *m, const char *name);
+void telemetry_unmap(struct telemetry_map *m);
+
+// points published by a rig so far
+uint64_t telemetry_head(const struct telemetry_map *m, int rig);
+
+// consistent copy of the run state of a rig
+void telemetry_state(const struct telemetry_map *m, int rig, struct tlm_state *s);
+
+// copy point <n> of a rig, returns 0, 1 if it is not published yet and
+// -1 if it was overwritten
+int  telemetry_get(const struct telemetry_map *m, int rig, uint64_t n, struct point *p);
+
+#endif
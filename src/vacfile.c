@@ -0,0 +1,385 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "vacfile.h"
+
+// === text
+int vac_print_point(FILE *fp, const struct point *p)
+{
+	return fprintf(fp, "%d\t%le\t%+le\t%+le\t%+le\t%+le\t%le\t%le\t%le\t%d\t%d\n",
+		p->index,
+		p->time,
+		p->V1, p->I1, p->V2, p->I2,
+		p->settle,
+		p->I1_std, p->I2_std, p->samples,
+		p->compliance
+	);
+}
+
+// === little-endian encoding
+static void put_u32(unsigned char *b, uint32_t v)
+{
+	int k;
+	for (k = 0; k < 4; k++)
+		b[k] = v >> (8 * k);
+}
+
+static void put_u64(unsigned char *b, uint64_t v)
+{
+	int k;
+	for (k = 0; k < 8; k++)
+		b[k] = v >> (8 * k);
+}
+
+static void put_f64(unsigned char *b, double v)
+{
+	uint64_t u;
+	memcpy(&u, &v, 8);
+	put_u64(b, u);
+}
+
+static uint32_t get_u32(const unsigned char *b)
+{
+	uint32_t v = 0;
+	int k;
+	for (k = 3; k >= 0; k--)
+		v = (v << 8) | b[k];
+	return v;
+}
+
+static uint64_t get_u64(const unsigned char *b)
+{
+	uint64_t v = 0;
+	int k;
+	for (k = 7; k >= 0; k--)
+		v = (v << 8) | b[k];
+	return v;
+}
+
+static double get_f64(const unsigned char *b)
+{
+	uint64_t u = get_u64(b);
+	double v;
+	memcpy(&v, &u, 8);
+	return v;
+}
+
+static int write_all(int fd, const unsigned char *b, size_t len)
+{
+	ssize_t n;
+
+	while (len > 0)
+	{
+		n = write(fd, b, len);
+		if (n < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			return -errno;
+		}
+		b   += n;
+		len -= n;
+	}
+	return 0;
+}
+
+// === writer
+int vacbin_create(struct vacbin *b, const char *path, const struct vacbin_header *h)
+{
+	unsigned char *hb;
+	size_t size;
+	int k, r;
+
+	size = (VACBIN_FIXED_SIZE + h->text_size + 7) & ~((size_t) 7);
+	hb = calloc(1, size);
+	if (hb == NULL)
+		return -ENOMEM;
+
+	memcpy(hb, VACBIN_MAGIC, 8);
+	put_u32(hb + 8, VACBIN_VERSION);
+	put_u32(hb + 12, size);
+	put_u32(hb + 16, VACBIN_RECORD_SIZE);
+	put_u32(hb + 20, h->chan);
+	put_u64(hb + 24, h->start_time);
+	for (k = 0; k < 6; k++)
+		put_u32(hb + 32 + 4 * k, h->date[k]);
+	put_f64(hb + 56,  h->V1_start);
+	put_f64(hb + 64,  h->V1_stop);
+	put_f64(hb + 72,  h->V1_step);
+	put_f64(hb + 80,  h->I1_max);
+	put_f64(hb + 88,  h->V2_start);
+	put_f64(hb + 96,  h->V2_stop);
+	put_f64(hb + 104, h->V2_step);
+	put_f64(hb + 112, h->I2_max);
+	put_f64(hb + 120, h->delay);
+	strncpy((char *) hb + 128, h->sample_name, 127);
+	put_u32(hb + 256, h->text_size);
+	if (h->text_size > 0)
+		memcpy(hb + VACBIN_FIXED_SIZE, h->text, h->text_size);
+
+	b->len = 0;
+	b->records = 0;
+	b->buf = malloc(VACBIN_BUF);
+	if (b->buf == NULL)
+	{
+		free(hb);
+		return -ENOMEM;
+	}
+
+	b->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (b->fd < 0)
+	{
+		r = -errno;
+		free(hb);
+		free(b->buf);
+		return r;
+	}
+
+	r = write_all(b->fd, hb, size);
+	free(hb);
+	if (r < 0)
+	{
+		close(b->fd);
+		free(b->buf);
+	}
+	return r;
+}
+
+int vacbin_reopen(struct vacbin *b, const char *path, uint64_t records)
+{
+	unsigned char hb[VACBIN_FIXED_SIZE];
+	uint32_t header_size;
+	struct stat st;
+	off_t size;
+	ssize_t n;
+	int r;
+
+	b->fd = open(path, O_RDWR);
+	if (b->fd < 0)
+		return -errno;
+
+	n = pread(b->fd, hb, sizeof(hb), 0);
+	if (n < 0)
+	{
+		r = -errno;
+		goto reopen_fail;
+	}
+
+	// only records of the size written here can follow
+	header_size = get_u32(hb + 12);
+	size = header_size + records * VACBIN_RECORD_SIZE;
+	if ((n != sizeof(hb)) || (memcmp(hb, VACBIN_MAGIC, 8) != 0) ||
+		(get_u32(hb + 8) != VACBIN_VERSION) || (get_u32(hb + 16) != VACBIN_RECORD_SIZE) ||
+		(header_size < VACBIN_FIXED_SIZE))
+	{
+		r = -EINVAL;
+		goto reopen_fail;
+	}
+
+	if (fstat(b->fd, &st) < 0)
+	{
+		r = -errno;
+		goto reopen_fail;
+	}
+	if (st.st_size < size)
+	{
+		r = -EINVAL;
+		goto reopen_fail;
+	}
+	if ((ftruncate(b->fd, size) < 0) || (lseek(b->fd, size, SEEK_SET) < 0))
+	{
+		r = -errno;
+		goto reopen_fail;
+	}
+
+	b->len = 0;
+	b->records = records;
+	b->buf = malloc(VACBIN_BUF);
+	if (b->buf == NULL)
+	{
+		r = -ENOMEM;
+		goto reopen_fail;
+	}
+	return 0;
+
+	reopen_fail:
+	close(b->fd);
+	return r;
+}
+
+int vacbin_append(struct vacbin *b, const struct point *p)
+{
+	unsigned char *r;
+	int ret;
+
+	if (b->len + VACBIN_RECORD_SIZE > VACBIN_BUF)
+	{
+		ret = vacbin_flush(b);
+		if (ret < 0)
+			return ret;
+	}
+
+	r = b->buf + b->len;
+	put_u32(r,      p->index);
+	put_f64(r + 4,  p->time);
+	put_f64(r + 12, p->V1);
+	put_f64(r + 20, p->I1);
+	put_f64(r + 28, p->V2);
+	put_f64(r + 36, p->I2);
+	put_u32(r + 44, p->stage);
+	put_f64(r + 48, p->settle);
+	put_f64(r + 56, p->I1_std);
+	put_f64(r + 64, p->I2_std);
+	put_u32(r + 72, p->samples);
+	put_u32(r + 76, p->compliance);
+	b->len += VACBIN_RECORD_SIZE;
+	b->records++;
+
+	return 0;
+}
+
+int vacbin_flush(struct vacbin *b)
+{
+	int r;
+
+	if (b->len == 0)
+		return 0;
+
+	r = write_all(b->fd, b->buf, b->len);
+	b->len = 0;
+	return r;
+}
+
+int vacbin_close(struct vacbin *b)
+{
+	int r;
+
+	r = vacbin_flush(b);
+	if ((close(b->fd) < 0) && (r == 0))
+		r = -errno;
+	free(b->buf);
+	b->buf = NULL;
+
+	return r;
+}
+
+// === reader
+int vacbin_map(struct vacbin_map *m, const char *path)
+{
+	const unsigned char *b;
+	struct stat st;
+	int fd, k, r;
+
+	memset(m, 0, sizeof(struct vacbin_map));
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return -errno;
+
+	if (fstat(fd, &st) < 0)
+	{
+		r = -errno;
+		close(fd);
+		return r;
+	}
+	if (st.st_size < VACBIN_FIXED_SIZE)
+	{
+		close(fd);
+		return -EINVAL;
+	}
+
+	m->size = st.st_size;
+	m->base = mmap(NULL, m->size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (m->base == MAP_FAILED)
+	{
+		m->base = NULL;
+		return -errno;
+	}
+	madvise(m->base, m->size, MADV_SEQUENTIAL);
+
+	b = m->base;
+	m->h.version     = get_u32(b + 8);
+	m->h.header_size = get_u32(b + 12);
+	m->h.record_size = get_u32(b + 16);
+	if ((memcmp(b, VACBIN_MAGIC, 8) != 0) ||
+		(m->h.header_size < VACBIN_FIXED_SIZE) || (m->h.header_size > m->size) ||
+		(m->h.record_size < VACBIN_RECORD_MIN))
+	{
+		vacbin_unmap(m);
+		return -EINVAL;
+	}
+
+	m->h.chan       = get_u32(b + 20);
+	m->h.start_time = get_u64(b + 24);
+	for (k = 0; k < 6; k++)
+		m->h.date[k] = get_u32(b + 32 + 4 * k);
+	m->h.V1_start = get_f64(b + 56);
+	m->h.V1_stop  = get_f64(b + 64);
+	m->h.V1_step  = get_f64(b + 72);
+	m->h.I1_max   = get_f64(b + 80);
+	m->h.V2_start = get_f64(b + 88);
+	m->h.V2_stop  = get_f64(b + 96);
+	m->h.V2_step  = get_f64(b + 104);
+	m->h.I2_max   = get_f64(b + 112);
+	m->h.delay    = get_f64(b + 120);
+	memcpy(m->h.sample_name, b + 128, 127);
+	m->h.text_size = get_u32(b + 256);
+	if (VACBIN_FIXED_SIZE + (size_t) m->h.text_size > m->h.header_size)
+	{
+		vacbin_unmap(m);
+		return -EINVAL;
+	}
+	m->h.text = (const char *) b + VACBIN_FIXED_SIZE;
+
+	// a partially written trailing record is ignored
+	m->rec = b + m->h.header_size;
+	m->n   = (m->size - m->h.header_size) / m->h.record_size;
+
+	return 0;
+}
+
+void vacbin_get(const struct vacbin_map *m, size_t k, struct point *p)
+{
+	const unsigned char *r = m->rec + k * m->h.record_size;
+
+	p->index = (int32_t) get_u32(r);
+	p->time  = get_f64(r + 4);
+	p->V1    = get_f64(r + 12);
+	p->I1    = get_f64(r + 20);
+	p->V2    = get_f64(r + 28);
+	p->I2    = get_f64(r + 36);
+	p->stage = (int32_t) get_u32(r + 44);
+	// version 1 records end before the settle time, version 2 records
+	// before the sample statistics and hold single readings
+	p->settle = (m->h.record_size >= 56) ? get_f64(r + 48) : NAN;
+	if (m->h.record_size >= 80)
+	{
+		p->I1_std  = get_f64(r + 56);
+		p->I2_std  = get_f64(r + 64);
+		p->samples = (int32_t) get_u32(r + 72);
+		p->compliance = (int32_t) get_u32(r + 76);
+	}
+	else
+	{
+		p->I1_std  = NAN;
+		p->I2_std  = NAN;
+		p->samples = 1;
+		p->compliance = 0;
+	}
+}
+
+void vacbin_unmap(struct vacbin_map *m)
+{
+	if (m->base != NULL)
+		munmap(m->base, m->size);
+	m->base = NULL;
+}
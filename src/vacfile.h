@@ -0,0 +1,102 @@
+#ifndef VACFILE_H
+#define VACFILE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#include "point.h"
+
+// === [VAC TEXT] ===
+// one vac.dat data row
+int vac_print_point(FILE *fp, const struct point *p);
+
+// === [VAC BINARY] ===
+// vac.bin layout, all fields little-endian:
+//   0    8  magic "FET4PVAC"
+//   8    4  u32 version
+//   12   4  u32 header_size, offset of the first record
+//   16   4  u32 record_size
+//   20   4  i32 Chan
+//   24   8  i64 start time, unix s
+//   32  24  i32 year, month, day, hour, minute, second (local time)
+//   56  72  f64 V1_start, V1_stop, V1_step, I1_max,
+//               V2_start, V2_stop, V2_step, I2_max, Delay
+//   128 128 sample name, NUL padded
+//   256  4  u32 text_size
+//   260  .  vac.dat text header (text_size bytes), zero padded to 8 bytes
+// followed by packed records:
+//   0    4  i32 index
+//   4    8  f64 time, s
+//   12   8  f64 V1, V
+//   20   8  f64 I1, A
+//   28   8  f64 V2, V
+//   36   8  f64 I2, A
+//   44   4  i32 stage
+//   48   8  f64 settle time, s (version 2)
+//   56   8  f64 I1 standard deviation, A (version 3)
+//   64   8  f64 I2 standard deviation, A (version 3)
+//   72   4  i32 samples (version 3)
+//   76   4  i32 compliance flags (version 4, zero in version 3)
+// readers must use header_size and record_size to step through the file
+#define VACBIN_MAGIC       "FET4PVAC"
+#define VACBIN_VERSION     4
+#define VACBIN_FIXED_SIZE  260
+#define VACBIN_RECORD_SIZE 80
+#define VACBIN_RECORD_MIN  48 // version 1 records
+#define VACBIN_BUF         (1 << 16) // append block size, bytes
+
+struct vacbin_header
+{
+	uint32_t version;
+	uint32_t header_size;
+	uint32_t record_size;
+	int32_t  chan;
+	int64_t  start_time;
+	int32_t  date[6];
+	double   V1_start;
+	double   V1_stop;
+	double   V1_step;
+	double   I1_max;
+	double   V2_start;
+	double   V2_stop;
+	double   V2_step;
+	double   I2_max;
+	double   delay;
+	char     sample_name[128];
+	uint32_t text_size;
+	const char *text;
+};
+
+// writer
+struct vacbin
+{
+	int    fd;
+	unsigned char *buf;
+	size_t len;
+	uint64_t records; // appended, flushed or not
+};
+
+int  vacbin_create(struct vacbin *b, const char *path, const struct vacbin_header *h);
+// continue a file of this version after its first <records> records,
+// the records past them are cut off
+int  vacbin_reopen(struct vacbin *b, const char *path, uint64_t records);
+int  vacbin_append(struct vacbin *b, const struct point *p);
+int  vacbin_flush(struct vacbin *b);
+int  vacbin_close(struct vacbin *b);
+
+// mmap reader
+struct vacbin_map
+{
+	void  *base;
+	size_t size;
+	struct vacbin_header h;
+	const unsigned char *rec;
+	size_t n;
+};
+
+int  vacbin_map(struct vacbin_map *m, const char *path);
+void vacbin_get(const struct vacbin_map *m, size_t k, struct point *p);
+void vacbin_unmap(struct vacbin_map *m);
+
+#endif
@@ -0,0 +1,99 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <argp.h>
+
+#include "vacfile.h"
+
+// === [ARGUMENTS] ===
+const char *argp_program_version = "vac2dat 0.1";
+const char *argp_program_bug_address = "<killingrain@gmail.com>";
+static char doc[] =
+	"VAC2DAT -- convert a binary fet4p run file (vac.bin) into the vac.dat "
+	"text layout";
+static char args_doc[] = "VAC_BIN [VAC_DAT]";
+
+struct arguments
+{
+	char *in;
+	char *out;
+};
+
+static error_t parse_opt (int key, char *arg, struct argp_state *state)
+{
+	struct arguments *a = state->input;
+
+	switch (key)
+	{
+		case ARGP_KEY_ARG:
+			if (state->arg_num == 0)
+				a->in = arg;
+			else if (state->arg_num == 1)
+				a->out = arg;
+			else
+				argp_usage(state);
+			break;
+		case ARGP_KEY_END:
+			if (a->in == NULL)
+				argp_usage(state);
+			break;
+		default:
+			return ARGP_ERR_UNKNOWN;
+	}
+	return 0;
+}
+
+static struct argp argp = {NULL, parse_opt, args_doc, doc, NULL, NULL, NULL};
+
+int main(int argc, char **argv)
+{
+	struct arguments arg = {0};
+	struct vacbin_map m;
+	struct point p;
+	FILE *fp;
+	size_t k;
+	int r;
+
+	argp_parse(&argp, argc, argv, 0, 0, &arg);
+
+	r = vacbin_map(&m, arg.in);
+	if (r < 0)
+	{
+		fprintf(stderr, "# E: Unable to read file \"%s\" (%s)\n", arg.in, strerror(-r));
+		return 1;
+	}
+
+	fp = stdout;
+	if (arg.out != NULL)
+	{
+		fp = fopen(arg.out, "w");
+		if (fp == NULL)
+		{
+			fprintf(stderr, "# E: Unable to open file \"%s\" (%s)\n", arg.out, strerror(errno));
+			vacbin_unmap(&m);
+			return 2;
+		}
+	}
+	setvbuf(fp, NULL, _IOFBF, 1 << 16);
+
+	fwrite(m.h.text, 1, m.h.text_size, fp);
+	for (k = 0; k < m.n; k++)
+	{
+		vacbin_get(&m, k, &p);
+		if (vac_print_point(fp, &p) < 0)
+			break;
+	}
+
+	r = 0;
+	if ((fflush(fp) == EOF) || ferror(fp))
+	{
+		fprintf(stderr, "# E: Unable to write output (%s)\n", strerror(errno));
+		r = 3;
+	}
+	if (fp != stdout)
+		fclose(fp);
+	vacbin_unmap(&m);
+
+	return r;
+}
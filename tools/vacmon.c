@@ -0,0 +1,236 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <signal.h>
+#include <argp.h>
+
+#include "telemetry.h"
+#include "vacfile.h"
+
+#define VACMON_POLL 0.01 // period of looking for new points, s
+#define VACMON_WAIT 0.1  // period of looking for the object, s
+
+// === [ARGUMENTS] ===
+const char *argp_program_version = "vacmon 0.1";
+const char *argp_program_bug_address = "<killingrain@gmail.com>";
+static char doc[] =
+	"VACMON -- follow the points and the run state a fet4p run publishes "
+	"with --telemetry NAME; the point rows are the vac.dat rows after the "
+	"rig number";
+static char args_doc[] = "NAME";
+
+#define OPT_STATE  1 // --state
+#define OPT_PERIOD 2 // --period
+
+static struct argp_option options[] =
+{
+	{"rig"   , 'r'       , "int"   , 0, "Only this rig (1 - rigs, default all)"                     , 0},
+	{"all"   , 'a'       , 0       , 0, "Start with the oldest point kept instead of the next one"  , 0},
+	{"state" , OPT_STATE , 0       , 0, "Print the run state of the rigs instead of the points"     , 0},
+	{"period", OPT_PERIOD, "double", 0, "Run state period, s (0.01 - 3600.0, default 1.0)"          , 0},
+	{0}
+};
+
+struct arguments
+{
+	char   *name;
+	int     rig;
+	int     all;
+	int     state;
+	double  period;
+};
+
+static error_t parse_opt (int key, char *arg, struct argp_state *state)
+{
+	struct arguments *a = state->input;
+
+	switch (key)
+	{
+		case 'r':
+			a->rig = atoi(arg);
+			if (a->rig < 1)
+				argp_error(state, "<rig> is out of range");
+			break;
+		case 'a':
+			a->all = 1;
+			break;
+		case OPT_STATE:
+			a->state = 1;
+			break;
+		case OPT_PERIOD:
+			a->period = atof(arg);
+			if ((a->period < 0.01) || (a->period > 3600.0))
+				argp_error(state, "<period> is out of range");
+			break;
+		case ARGP_KEY_ARG:
+			if (state->arg_num > 0)
+				argp_usage(state);
+			a->name = arg;
+			break;
+		case ARGP_KEY_END:
+			if (a->name == NULL)
+				argp_usage(state);
+			break;
+		default:
+			return ARGP_ERR_UNKNOWN;
+	}
+	return 0;
+}
+
+static struct argp argp = {options, parse_opt, args_doc, doc, NULL, NULL, NULL};
+
+static void sleep_s(double t)
+{
+	struct timespec ts = {t, (t - (time_t) t) * 1e9};
+	nanosleep(&ts, NULL);
+}
+
+// the writer has finished or is gone without closing
+static int writer_done(const struct telemetry_map *m)
+{
+	if (atomic_load(&m->h->closed))
+		return 1;
+	return (kill(m->h->pid, 0) == -1) && (errno == ESRCH);
+}
+
+static void print_state(const struct telemetry_map *m, int rig)
+{
+	struct tlm_state s;
+
+	telemetry_state(m, rig, &s);
+	printf("%d\t%d\t%d\t%d\t%d\t%+le\t%d\t%le\t%s\n",
+		rig + 1, s.entry, s.running, s.stage, s.index, s.setpoint, s.compliance, s.time, s.sample_name);
+}
+
+int main(int argc, char **argv)
+{
+	struct arguments arg = {0};
+	struct telemetry_map m;
+	struct tlm_state s;
+	struct point p;
+	uint64_t *next;
+	int *entry;
+	uint64_t head;
+	int first, last;
+	int done, idle;
+	int k, r;
+
+	arg.period = 1.0;
+	argp_parse(&argp, argc, argv, 0, 0, &arg);
+
+	// the run may not have started yet
+	while ((r = telemetry_map(&m, arg.name)) < 0)
+	{
+		if ((r != -ENOENT) && (r != -EAGAIN))
+		{
+			fprintf(stderr, "# E: Unable to map telemetry \"%s%s\" (%s)\n", TLM_PREFIX, arg.name, strerror(-r));
+			return 1;
+		}
+		sleep_s(VACMON_WAIT);
+	}
+
+	first = 0;
+	last  = m.h->rigs - 1;
+	if (arg.rig > 0)
+	{
+		if (arg.rig > (int) m.h->rigs)
+		{
+			fprintf(stderr, "# E: No rig %d, the run has %u\n", arg.rig, m.h->rigs);
+			telemetry_unmap(&m);
+			return 2;
+		}
+		first = last = arg.rig - 1;
+	}
+
+	setvbuf(stdout, NULL, _IOLBF, 0);
+
+	if (arg.state)
+	{
+		printf("# 1: rig\n# 2: entry\n# 3: running\n# 4: stage\n# 5: index\n"
+			"# 6: setpoint, V\n# 7: compliance\n# 8: time, s\n# 9: sample name\n");
+		do
+		{
+			done = writer_done(&m);
+			for (k = first; k <= last; k++)
+				print_state(&m, k);
+			if (!done)
+				sleep_s(arg.period);
+		}
+		while (!done);
+
+		telemetry_unmap(&m);
+		return 0;
+	}
+
+	next  = calloc(m.h->rigs, sizeof(uint64_t));
+	entry = calloc(m.h->rigs, sizeof(int));
+	if ((next == NULL) || (entry == NULL))
+	{
+		fprintf(stderr, "# E: Out of memory\n");
+		telemetry_unmap(&m);
+		return 3;
+	}
+
+	// the slots still hold the last TLM_SLOTS points of every rig
+	for (k = first; k <= last; k++)
+	{
+		head = telemetry_head(&m, k);
+		next[k] = head;
+		if (arg.all)
+			next[k] = (head > TLM_SLOTS) ? head - TLM_SLOTS : 0;
+	}
+
+	for (;;)
+	{
+		// a writer done before the last pass leaves nothing behind it
+		done = writer_done(&m);
+		idle = 1;
+
+		for (k = first; k <= last; k++)
+		{
+			telemetry_state(&m, k, &s);
+			if (s.entry != entry[k])
+			{
+				printf("# rig %d: entry %d, %s\n", k + 1, s.entry, s.sample_name);
+				entry[k] = s.entry;
+			}
+
+			head = telemetry_head(&m, k);
+			while (next[k] < head)
+			{
+				r = telemetry_get(&m, k, next[k], &p);
+				if (r == 1)
+					break;
+				if (r < 0)
+				{
+					// overwritten, go on with the oldest point kept
+					head = telemetry_head(&m, k);
+					fprintf(stderr, "# W: rig %d: %" PRIu64 " points overwritten before they were read\n",
+						k + 1, head - TLM_SLOTS - next[k]);
+					next[k] = head - TLM_SLOTS;
+					continue;
+				}
+
+				printf("%d\t", k + 1);
+				vac_print_point(stdout, &p);
+				next[k]++;
+				idle = 0;
+			}
+		}
+
+		if (done && idle)
+			break;
+		if (idle)
+			sleep_s(VACMON_POLL);
+	}
+
+	free(next);
+	free(entry);
+	telemetry_unmap(&m);
+	return 0;
+}
@@ -0,0 +1,493 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <argp.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "analyze.h"
+
+// === [ARGUMENTS] ===
+const char *argp_program_version = "vacscan 0.1";
+const char *argp_program_bug_address = "<killingrain@gmail.com>";
+static char doc[] =
+	"VACSCAN -- find every vac.dat below the given directories and write the "
+	"stage 2 transfer curve parameters of each run as one table";
+static char args_doc[] = "DIR...";
+
+#define OPT_FIT_WINDOW 1 // --fit_window
+#define OPT_GEOMETRY   2 // --geometry
+
+static struct argp_option options[] =
+{
+	{"jobs"      , 'j'           , "int"   , 0, "Worker threads (default: online CPUs)"                  , 0},
+	{"output"    , 'o'           , "file"  , 0, "Table file (default stdout)"                           , 0},
+	{"fit_window", OPT_FIT_WINDOW, "int"   , 0, "Points per sliding fit (3 - 100, default 5)"           , 0},
+	{"geometry"  , OPT_GEOMETRY  , "L,W,Ci", 0, "Channel length and width, m, and gate capacitance, F/m^2", 0},
+	{0}
+};
+
+struct arguments
+{
+	char  **dir;
+	int     dirs;
+	char   *out;
+	int     jobs;
+	int     fit_window;
+	double  mu_k;
+};
+
+static error_t parse_opt (int key, char *arg, struct argp_state *state)
+{
+	struct arguments *a = state->input;
+	double L, W, C;
+
+	switch (key)
+	{
+		case 'j':
+			a->jobs = atoi(arg);
+			if ((a->jobs < 1) || (a->jobs > 1024))
+				argp_error(state, "<jobs> is out of range");
+			break;
+		case 'o':
+			a->out = arg;
+			break;
+		case OPT_FIT_WINDOW:
+			a->fit_window = atoi(arg);
+			if ((a->fit_window < 3) || (a->fit_window > FIT_WINDOW_MAX))
+				argp_error(state, "<fit_window> is out of range");
+			break;
+		case OPT_GEOMETRY:
+			if ((sscanf(arg, "%lf,%lf,%lf", &L, &W, &C) != 3) || (L <= 0) || (W <= 0) || (C <= 0))
+				argp_error(state, "<geometry> is out of range");
+			a->mu_k = L / (W * C);
+			break;
+		case ARGP_KEY_ARGS:
+			a->dir  = state->argv + state->next;
+			a->dirs = state->argc - state->next;
+			break;
+		case ARGP_KEY_NO_ARGS:
+			argp_usage(state);
+			break;
+		default:
+			return ARGP_ERR_UNKNOWN;
+	}
+	return 0;
+}
+
+static struct argp argp = {options, parse_opt, args_doc, doc, NULL, NULL, NULL};
+
+// === [SCAN] ===
+#define SCAN_NAME "vac.dat"
+#define SCAN_FDS  64 // directories nftw keeps open
+#define STAGE_TOL 1e-3 // setpoint tolerance without a plan unit in the header, V
+
+// results of the longest sweep segment in the stage 2 direction
+struct run
+{
+	char  *path;
+	char   sample[128];
+	int    chan;
+	int    rows;
+	int    error;
+	int    points;
+	double gm, V_gm, Vth, ss, I_on, I_off, R, mu;
+};
+
+static struct arguments arg;
+static struct run *runs;
+static size_t nruns, cap;
+static atomic_size_t next_run;
+
+// === directory walk
+static int walk_file(const char *path, const struct stat *st, int flag, struct FTW *ftw)
+{
+	struct run *r;
+
+	(void) st;
+
+	if ((flag != FTW_F) || (strcmp(path + ftw->base, SCAN_NAME) != 0))
+		return 0;
+
+	if (nruns == cap)
+	{
+		cap = cap ? 2 * cap : 1024;
+		r = realloc(runs, cap * sizeof(struct run));
+		if (r == NULL)
+			return -1;
+		runs = r;
+	}
+
+	memset(&runs[nruns], 0, sizeof(struct run));
+	runs[nruns].path = strdup(path);
+	if (runs[nruns].path == NULL)
+		return -1;
+	nruns++;
+
+	return 0;
+}
+
+static int run_cmp(const void *a, const void *b)
+{
+	return strcmp(((const struct run *) a)->path, ((const struct run *) b)->path);
+}
+
+// === allocation-free parsing of the mapped text
+static const double pow10_table[] =
+{
+	1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+	1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+static double scale10(double v, int e)
+{
+	while (e > 22)  { v *= 1e22; e -= 22; }
+	while (e < -22) { v /= 1e22; e += 22; }
+	return (e >= 0) ? v * pow10_table[e] : v / pow10_table[-e];
+}
+
+// one number in the %le / %d layout of vac.dat, "nan" and "inf" included
+// returns the position after it, or NULL if there is no number at c
+static const char *scan_num(const char *c, const char *end, double *v)
+{
+	uint64_t m = 0;
+	int neg = 0, digits = 0, e = 0, ex = 0, eneg = 0;
+
+	while ((c < end) && ((*c == ' ') || (*c == '\t')))
+		c++;
+	if ((c < end) && ((*c == '+') || (*c == '-')))
+		neg = (*c++ == '-');
+
+	if ((end - c >= 3) && ((strncmp(c, "nan", 3) == 0) || (strncmp(c, "inf", 3) == 0)))
+	{
+		*v = (c[0] == 'n') ? NAN : (neg ? -INFINITY : INFINITY);
+		return c + 3;
+	}
+
+	for (; (c < end) && (*c >= '0') && (*c <= '9'); c++, digits++)
+	{
+		if (m < 1000000000000000000ULL)
+			m = m * 10 + (*c - '0');
+		else
+			e++;
+	}
+	if ((c < end) && (*c == '.'))
+		for (c++; (c < end) && (*c >= '0') && (*c <= '9'); c++, digits++)
+		{
+			if (m < 1000000000000000000ULL)
+			{
+				m = m * 10 + (*c - '0');
+				e--;
+			}
+		}
+	if (digits == 0)
+		return NULL;
+
+	if ((c < end) && ((*c == 'e') || (*c == 'E')))
+	{
+		c++;
+		if ((c < end) && ((*c == '+') || (*c == '-')))
+			eneg = (*c++ == '-');
+		for (; (c < end) && (*c >= '0') && (*c <= '9'); c++)
+			if (ex < 10000)
+				ex = ex * 10 + (*c - '0');
+		e += eneg ? -ex : ex;
+	}
+
+	*v = scale10((double) m, e);
+	if (neg)
+		*v = -*v;
+	return c;
+}
+
+static const char *next_line(const char *c, const char *end)
+{
+	c = memchr(c, '\n', end - c);
+	return c ? c + 1 : end;
+}
+
+// "#   name = value" line of the vac.dat header
+static const char *header_value(const char *c, const char *end, const char *name)
+{
+	size_t n = strlen(name);
+
+	c++;
+	while ((c < end) && (*c == ' '))
+		c++;
+	if (((size_t) (end - c) <= n) || (strncmp(c, name, n) != 0) || ((c[n] != ' ') && (c[n] != '=')))
+		return NULL;
+	for (c += n; (c < end) && ((*c == ' ') || (*c == '=')); c++)
+		;
+	return c;
+}
+
+// === one run
+static void run_keep(struct run *r, const struct analyze *a)
+{
+	r->points = a->points;
+	r->gm     = a->gm;
+	r->V_gm   = a->V_gm;
+	r->Vth    = a->Vth;
+	r->ss     = a->ss;
+	r->I_on   = a->I_on;
+	r->I_off  = (a->points > 0) ? a->I_off : NAN;
+	r->R      = a->R;
+	r->mu     = a->mu;
+}
+
+static int run_analyze(struct run *r)
+{
+	struct analyze_config cfg;
+	struct analyze a;
+	struct stat st;
+	struct point p;
+	const char *base, *c, *end, *v;
+	double x[6];
+	double sweep[4] = {0.0, 0.0, 0.0, 0.0}; // V1_start, V1_stop, V2_start, V2_stop
+	double unit = 0.0;
+	double V, V_prev = 0.0, V_start, V_stop, tol;
+	int fd, k, dir, seg;
+
+	fd = open(r->path, O_RDONLY);
+	if (fd < 0)
+		return -errno;
+	if (fstat(fd, &st) < 0)
+	{
+		close(fd);
+		return -errno;
+	}
+	if (st.st_size == 0)
+	{
+		close(fd);
+		return 0;
+	}
+
+	base = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (base == MAP_FAILED)
+		return -errno;
+	madvise((void *) base, st.st_size, MADV_SEQUENTIAL);
+
+	c   = base;
+	end = base + st.st_size;
+
+	// header
+	r->chan = 1;
+	for (; (c < end) && (*c == '#'); c = next_line(c, end))
+	{
+		if ((v = header_value(c, end, "sample_name")) != NULL)
+		{
+			for (k = 0; (v + k < end) && (v[k] != '\n') && (k < (int) sizeof(r->sample) - 1); k++)
+				r->sample[k] = v[k];
+			r->sample[k] = '\0';
+		}
+		else if ((v = header_value(c, end, "Chan")) != NULL)
+			r->chan = (*v == '2') ? 2 : 1;
+		else if ((v = header_value(c, end, "V1_start")) != NULL)
+			scan_num(v, end, &sweep[0]);
+		else if ((v = header_value(c, end, "V1_stop")) != NULL)
+			scan_num(v, end, &sweep[1]);
+		else if ((v = header_value(c, end, "V2_start")) != NULL)
+			scan_num(v, end, &sweep[2]);
+		else if ((v = header_value(c, end, "V2_stop")) != NULL)
+			scan_num(v, end, &sweep[3]);
+		else if ((v = header_value(c, end, "Step_min")) != NULL)
+			scan_num(v, end, &unit);
+	}
+
+	cfg.chan     = r->chan;
+	cfg.window   = arg.fit_window;
+	cfg.mu_k     = arg.mu_k;
+	cfg.stop_tol = 0.0;
+	analyze_init(&a, &cfg);
+	run_keep(r, &a);
+
+	// vac.dat has no stage column, stage 2 starts with the first point that
+	// reaches V_start from 0 V and ends before the point that reaches V_stop
+	// or turns back; every point is a multiple of the plan unit (Step_min)
+	// away from its stage start, so a quarter of it tells the setpoints
+	// apart from the readback error; a stage 2 ended early with "n" keeps
+	// the first point of stage 3, which steps on before it turns back
+	k       = (r->chan == 1) ? 0 : 2;
+	V_start = sweep[k];
+	V_stop  = sweep[k + 1];
+	dir     = (V_stop >= V_start) ? 1 : -1;
+	tol     = (unit > 0.0) ? unit / 4 : STAGE_TOL;
+	seg     = 0; // 0 - stage 1, 1 - stage 2, 2 - stage 3
+	memset(&p, 0, sizeof(p));
+	p.stage = 2;
+
+	for (; c < end; c = next_line(c, end))
+	{
+		if (*c == '#')
+			continue;
+
+		v = c;
+		for (k = 0; k < 6; k++)
+		{
+			v = scan_num(v, end, &x[k]);
+			if (v == NULL)
+				break;
+		}
+		if (k < 6)
+			continue;
+		r->rows++;
+
+		p.index = x[0]; p.time = x[1];
+		p.V1 = x[2]; p.I1 = x[3];
+		p.V2 = x[4]; p.I2 = x[5];
+		V = (r->chan == 1) ? p.V1 : p.V2;
+
+		if ((seg == 0) && (fabs(V - V_start) <= tol))
+			seg = 1;
+		else if ((seg == 1) && (((V - V_stop) * dir >= -tol) || ((V - V_prev) * dir <= 0)))
+			seg = 2;
+
+		if (seg == 1)
+			analyze_point(&a, &p);
+		V_prev = V;
+	}
+	run_keep(r, &a);
+
+	munmap((void *) base, st.st_size);
+	return 0;
+}
+
+static void *scan_thread(void *unused)
+{
+	size_t k;
+
+	(void) unused;
+
+	while ((k = atomic_fetch_add(&next_run, 1)) < nruns)
+		runs[k].error = run_analyze(&runs[k]);
+
+	return NULL;
+}
+
+// === table
+static void print_table(FILE *fp)
+{
+	const struct run *r;
+	size_t k;
+
+	fprintf(fp, "# 1: path\n");
+	fprintf(fp, "# 2: sample_name\n");
+	fprintf(fp, "# 3: Chan\n");
+	fprintf(fp, "# 4: rows\n");
+	fprintf(fp, "# 5: stage 2 points\n");
+	fprintf(fp, "# 6: gm, S\n");
+	fprintf(fp, "# 7: V_gm, V\n");
+	fprintf(fp, "# 8: Vth, V\n");
+	fprintf(fp, "# 9: SS, V/decade\n");
+	fprintf(fp, "# 10: I_on, A\n");
+	fprintf(fp, "# 11: I_off, A\n");
+	fprintf(fp, "# 12: on/off\n");
+	fprintf(fp, "# 13: R, Ohm\n");
+	fprintf(fp, "# 14: mu, cm^2/(V s)\n");
+
+	for (k = 0; k < nruns; k++)
+	{
+		r = &runs[k];
+		if (r->error < 0)
+		{
+			fprintf(stderr, "# E: Unable to read file \"%s\" (%s)\n", r->path, strerror(-r->error));
+			continue;
+		}
+		fprintf(fp, "%s\t%s\t%d\t%d\t%d\t%le\t%le\t%le\t%le\t%le\t%le\t%le\t%le\t%le\n",
+			r->path,
+			(r->sample[0] != '\0') ? r->sample : "-",
+			r->chan,
+			r->rows,
+			r->points,
+			r->gm,
+			r->V_gm,
+			r->Vth,
+			r->ss,
+			r->I_on,
+			r->I_off,
+			(r->I_off > 0) ? r->I_on / r->I_off : INFINITY,
+			r->R,
+			r->mu
+		);
+	}
+}
+
+int main(int argc, char **argv)
+{
+	pthread_t *thread;
+	FILE *fp;
+	int k, n, r;
+
+	arg.jobs       = sysconf(_SC_NPROCESSORS_ONLN);
+	arg.fit_window = FIT_WINDOW;
+	if (arg.jobs < 1)
+		arg.jobs = 1;
+
+	argp_parse(&argp, argc, argv, 0, 0, &arg);
+
+	for (k = 0; k < arg.dirs; k++)
+	{
+		if (nftw(arg.dir[k], walk_file, SCAN_FDS, FTW_PHYS) != 0)
+		{
+			fprintf(stderr, "# E: Unable to walk \"%s\" (%s)\n", arg.dir[k], strerror(errno));
+			return 1;
+		}
+	}
+	qsort(runs, nruns, sizeof(struct run), run_cmp);
+
+	thread = malloc(arg.jobs * sizeof(pthread_t));
+	if (thread == NULL)
+		return 2;
+
+	atomic_init(&next_run, 0);
+	for (n = 0; n < arg.jobs; n++)
+		if (pthread_create(&thread[n], NULL, scan_thread, NULL) != 0)
+			break;
+	if (n == 0)
+	{
+		fprintf(stderr, "# E: Unable to start threads\n");
+		return 2;
+	}
+	for (k = 0; k < n; k++)
+		pthread_join(thread[k], NULL);
+	free(thread);
+
+	fp = stdout;
+	if (arg.out != NULL)
+	{
+		fp = fopen(arg.out, "w");
+		if (fp == NULL)
+		{
+			fprintf(stderr, "# E: Unable to open file \"%s\" (%s)\n", arg.out, strerror(errno));
+			return 3;
+		}
+	}
+	setvbuf(fp, NULL, _IOFBF, 1 << 16);
+
+	print_table(fp);
+
+	r = 0;
+	if ((fflush(fp) == EOF) || ferror(fp))
+	{
+		fprintf(stderr, "# E: Unable to write output (%s)\n", strerror(errno));
+		r = 4;
+	}
+	if (fp != stdout)
+		fclose(fp);
+
+	for (k = 0; k < (int) nruns; k++)
+		free(runs[k].path);
+	free(runs);
+
+	return r;
+}